@@ -73,6 +73,9 @@ struct gip_client {
 	struct gip_chunk_buffer *chunk_buf;
 	struct gip_hardware hardware;
 
+	/* receive time of the packet being processed */
+	ktime_t timestamp;
+
 	struct gip_info_element *external_commands;
 	struct gip_info_element *firmware_versions;
 	struct gip_info_element *audio_formats;
@@ -1456,7 +1456,8 @@ static int gip_process_pkt(struct gip_client *client,
 	return gip_dispatch_pkt(client, hdr, data, hdr->packet_length);
 }
 
-int gip_process_buffer(struct gip_adapter *adap, void *data, int len)
+int gip_process_buffer(struct gip_adapter *adap, void *data, int len,
+		       ktime_t timestamp)
 {
 	struct gip_header hdr;
 	struct gip_client *client;
@@ -1471,6 +1472,7 @@ int gip_process_buffer(struct gip_adapter *adap, void *data, int len)
 		if (IS_ERR(client))
 			return PTR_ERR(client);
 
+		client->timestamp = timestamp;
 		err = gip_process_pkt(client, &hdr, data + hdr_len);
 		if (err)
 			return err;
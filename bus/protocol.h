@@ -6,6 +6,7 @@
 #pragma once
 
 #include <linux/types.h>
+#include <linux/ktime.h>
 #include <linux/uuid.h>
 
 #define GIP_VID_MICROSOFT 0x045e
@@ -109,4 +110,5 @@ int gip_init_audio_in(struct gip_client *client);
 int gip_init_audio_out(struct gip_client *client);
 void gip_disable_audio(struct gip_client *client);
 
-int gip_process_buffer(struct gip_adapter *adap, void *data, int len);
+int gip_process_buffer(struct gip_adapter *adap, void *data, int len,
+		       ktime_t timestamp);
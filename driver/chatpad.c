@@ -128,6 +128,7 @@ static int gip_chatpad_op_guide_button(struct gip_client *client, bool down)
 	struct gip_chatpad *chatpad = dev_get_drvdata(&client->dev);
 
 	input_report_key(chatpad->input.dev, BTN_MODE, down);
+	input_set_timestamp(chatpad->input.dev, client->timestamp);
 	input_sync(chatpad->input.dev);
 
 	return 0;
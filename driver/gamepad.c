@@ -236,6 +236,7 @@ static int gip_gamepad_op_guide_button(struct gip_client *client, bool down)
 	struct gip_gamepad *gamepad = dev_get_drvdata(&client->dev);
 
 	input_report_key(gamepad->input.dev, BTN_MODE, down);
+	input_set_timestamp(gamepad->input.dev, client->timestamp);
 	input_sync(gamepad->input.dev);
 
 	return 0;
@@ -286,6 +287,7 @@ static int gip_gamepad_op_input(struct gip_client *client, void *data, u32 len)
 					 !!(buttons & GIP_GP_BTN_DPAD_L));
 	input_report_abs(dev, ABS_HAT0Y, !!(buttons & GIP_GP_BTN_DPAD_D) -
 					 !!(buttons & GIP_GP_BTN_DPAD_U));
+	input_set_timestamp(dev, client->timestamp);
 	input_sync(dev);
 
 	return 0;
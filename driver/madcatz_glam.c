@@ -108,6 +108,7 @@ static int gip_glam_op_guide_button(struct gip_client *client, bool down)
 	struct gip_glam *glam = dev_get_drvdata(&client->dev);
 
 	input_report_key(glam->input.dev, BTN_MODE, down);
+	input_set_timestamp(glam->input.dev, client->timestamp);
 	input_sync(glam->input.dev);
 
 	return 0;
@@ -148,6 +149,7 @@ static int gip_glam_op_input(struct gip_client *client, void *data, u32 len)
 					 !!(buttons & GIP_GL_BTN_DPAD_L));
 	input_report_abs(dev, ABS_HAT0Y, !!(buttons & GIP_GL_BTN_DPAD_D) -
 					 !!(buttons & GIP_GL_BTN_DPAD_U));
+	input_set_timestamp(dev, client->timestamp);
 	input_sync(dev);
 
 	return 0;
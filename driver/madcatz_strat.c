@@ -99,6 +99,7 @@ static int gip_strat_op_guide_button(struct gip_client *client, bool down)
 	struct gip_strat *strat = dev_get_drvdata(&client->dev);
 
 	input_report_key(strat->input.dev, BTN_MODE, down);
+	input_set_timestamp(strat->input.dev, client->timestamp);
 	input_sync(strat->input.dev);
 
 	return 0;
@@ -145,6 +146,7 @@ static int gip_strat_op_input(struct gip_client *client, void *data, u32 len)
 					 !!(buttons & GIP_ST_BTN_DPAD_L));
 	input_report_abs(dev, ABS_HAT0Y, !!(buttons & GIP_ST_BTN_DPAD_D) -
 					 !!(buttons & GIP_ST_BTN_DPAD_U));
+	input_set_timestamp(dev, client->timestamp);
 	input_sync(dev);
 
 	return 0;
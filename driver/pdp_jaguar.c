@@ -97,6 +97,7 @@ static int gip_jaguar_op_guide_button(struct gip_client *client, bool down)
 	struct gip_jaguar *guitar = dev_get_drvdata(&client->dev);
 
 	input_report_key(guitar->input.dev, BTN_MODE, down);
+	input_set_timestamp(guitar->input.dev, client->timestamp);
 	input_sync(guitar->input.dev);
 
 	return 0;
@@ -144,6 +145,7 @@ static int gip_jaguar_op_input(struct gip_client *client, void *data, u32 len)
 					 !!(buttons & GIP_JA_BTN_DPAD_L));
 	input_report_abs(dev, ABS_HAT0Y, !!(buttons & GIP_JA_BTN_DPAD_D) -
 					 !!(buttons & GIP_JA_BTN_DPAD_U));
+	input_set_timestamp(dev, client->timestamp);
 	input_sync(dev);
 
 	return 0;
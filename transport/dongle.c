@@ -8,22 +8,87 @@
 #include <linux/bitfield.h>
 #include <linux/version.h>
 #include <linux/usb.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/etherdevice.h>
+#include <linux/average.h>
+#include <linux/vmalloc.h>
+#include <linux/devcoredump.h>
 #include <linux/ieee80211.h>
 #include <net/cfg80211.h>
 
 #include "mt76.h"
 #include "../bus/bus.h"
 
-#define XONE_DONGLE_NUM_IN_URBS 12
-#define XONE_DONGLE_NUM_OUT_URBS 12
+#define XONE_DONGLE_NUM_DATA_URBS 8
+#define XONE_DONGLE_NUM_AUDIO_URBS 8
 
 #define XONE_DONGLE_LEN_CMD_PKT 0x0654
 #define XONE_DONGLE_LEN_WLAN_PKT 0x8400
 
 #define XONE_DONGLE_MAX_CLIENTS 16
 
-/* autosuspend delay in ms */
-#define XONE_DONGLE_SUSPEND_DELAY 60000
+/* size of the event ring, must be a power of two */
+#define XONE_DONGLE_NUM_EVENTS 64
+
+/* max number of queued packets per client */
+#define XONE_DONGLE_TX_QUEUE_LEN 32
+
+/* bytes credited per client and scheduling round */
+#define XONE_DONGLE_TX_QUANTUM 256
+
+/* additional bulk-in URBs per connected client */
+#define XONE_DONGLE_RX_URBS_PER_CLIENT 2
+
+/* completions per second that justify an additional bulk-in URB */
+#define XONE_DONGLE_RX_RATE_PER_URB 500
+
+#define XONE_DONGLE_RX_TUNE_INTERVAL msecs_to_jiffies(1000)
+
+/* channel score that triggers a channel reselection */
+#define XONE_DONGLE_SURVEY_THRESHOLD 500
+
+/* minimum score improvement required to migrate clients */
+#define XONE_DONGLE_SURVEY_MARGIN 200
+
+/* score added to channels used by other dongles */
+#define XONE_DONGLE_CHANNEL_PENALTY 1000
+#define XONE_DONGLE_OVERLAP_PENALTY 500
+
+/* load of a single client, in units of channel busy time (permille) */
+#define XONE_DONGLE_CLIENT_LOAD 1000
+
+/* coredump is complete once no chunk arrived for this time */
+#define XONE_DONGLE_COREDUMP_TIMEOUT msecs_to_jiffies(50)
+#define XONE_DONGLE_COREDUMP_MAX_CHUNKS 256
+
+#define XONE_DONGLE_WATCHDOG_INTERVAL msecs_to_jiffies(5000)
+
+/* intervals without RX progress before the next recovery step */
+#define XONE_DONGLE_WATCHDOG_STALLS 3
+
+/* recheck interval while surveys are disabled */
+#define XONE_DONGLE_SURVEY_IDLE msecs_to_jiffies(10000)
+
+#define XONE_DONGLE_STATS_INTERVAL msecs_to_jiffies(1000)
+
+/* max number of TX status entries read per interval */
+#define XONE_DONGLE_TX_STATUS_BUDGET 32
+
+/* stats intervals between client statistics requests */
+#define XONE_DONGLE_STATS_REQ_INTERVAL 10
+
+#define XONE_DONGLE_LEN_CLIENT_STATS 32
+
+/* TX status entries required for a rate decision */
+#define XONE_DONGLE_RATE_MIN_FRAMES 10
+
+/* highest OFDM rate index used (24 Mbps) */
+#define XONE_DONGLE_RATE_MAX_INDEX 4
+
+/* reduced retry limits for links without failures */
+#define XONE_DONGLE_RETRY_SHORT_GOOD 4
+#define XONE_DONGLE_RETRY_LONG_GOOD 7
 
 #define XONE_DONGLE_PAIRING_TIMEOUT msecs_to_jiffies(30000)
 #define XONE_DONGLE_PWR_OFF_TIMEOUT msecs_to_jiffies(5000)
@@ -35,7 +100,42 @@ enum xone_dongle_queue {
 
 struct xone_dongle_skb_cb {
 	struct xone_dongle *dongle;
-	struct urb *urb;
+	struct xone_dongle_tx_pool *pool;
+};
+
+/* RSSI is stored negated, the average only supports unsigned values */
+DECLARE_EWMA(xone_rssi, 4, 8);
+
+/* resume latency in us */
+DECLARE_EWMA(xone_latency, 4, 4);
+
+struct xone_dongle_link_stats {
+	unsigned long rx_frames;
+	s8 rssi;
+	struct ewma_xone_rssi rssi_avg;
+
+	unsigned long tx_frames;
+	unsigned long tx_failed;
+	unsigned long tx_retries;
+
+	/* last response to XONE_MT_CLIENT_STATISTICS_REQ */
+	u8 client[XONE_DONGLE_LEN_CLIENT_STATS];
+	int client_len;
+};
+
+struct xone_dongle_rate_ctrl {
+	/* OFDM rate index, read without lock by the TX path */
+	u8 index;
+
+	/* TX status of the current decision window */
+	unsigned int frames;
+	unsigned int failed;
+	unsigned int retries;
+
+	/* packet error rate (in %) and retries per 10 frames of last window */
+	unsigned int last_per;
+	unsigned int last_retries;
+	bool good;
 };
 
 struct xone_dongle_client {
@@ -43,8 +143,20 @@ struct xone_dongle_client {
 	u8 wcid;
 	u8 address[ETH_ALEN];
 	bool encryption_enabled;
+	bool associated;
+
+	/* restored after firmware crashes */
+	u8 key[XONE_MT_WCID_KEY_LEN];
+	bool key_valid;
 
 	struct gip_adapter *adapter;
+
+	struct work_struct assoc_work;
+	ktime_t assoc_time;
+
+	/* protected by clients_lock */
+	struct xone_dongle_link_stats link;
+	struct xone_dongle_rate_ctrl rate;
 };
 
 struct xone_dongle_event {
@@ -53,23 +165,101 @@ struct xone_dongle_event {
 		XONE_DONGLE_EVT_REMOVE_CLIENT,
 		XONE_DONGLE_EVT_PAIR_CLIENT,
 		XONE_DONGLE_EVT_ENABLE_PAIRING,
+		XONE_DONGLE_EVT_OPEN_PAIRING,
 		XONE_DONGLE_EVT_ENABLE_ENCRYPTION,
 	} type;
 
-	struct xone_dongle *dongle;
 	u8 address[ETH_ALEN];
 	u8 wcid;
+	ktime_t time;
+
+	/* slot sequence number, see xone_dongle_push_event */
+	atomic_t seq;
+};
+
+struct xone_dongle_assoc_stats {
+	u8 address[ETH_ALEN];
+	s64 queue_us;
+	s64 adapter_us;
+	s64 associate_us;
+	s64 led_us;
+	s64 total_us;
+	int err;
+};
+
+struct xone_dongle_tx_queue {
+	struct sk_buff_head skbs;
+	struct list_head node;
+	int deficit;
+
+	unsigned long packets;
+	unsigned long bytes;
+	unsigned long drops;
+	unsigned int max_depth;
+};
+
+struct xone_dongle_tx_pool {
+	/* firmware queue, selects the EDCA access class */
+	enum xone_dongle_queue queue;
+
+	/* serializes access to queues */
+	spinlock_t lock;
+	struct usb_anchor urbs_idle;
+	struct usb_anchor urbs_busy;
+	struct xone_dongle_tx_queue queues[XONE_DONGLE_MAX_CLIENTS];
+	struct list_head active;
+
+	/* packets get queued but not submitted */
+	unsigned int plugged;
+
+	/* successful transfers, sampled by the watchdog */
+	unsigned long completions;
+};
 
-	struct work_struct work;
+struct xone_dongle_rx_pool {
+	struct xone_dongle *dongle;
+	int ep;
+	int buf_len;
+
+	/* serializes changes to the URB count */
+	spinlock_t lock;
+	struct usb_anchor urbs_idle;
+	struct usb_anchor urbs_busy;
+	struct usb_anchor urbs_retired;
+	unsigned int count;
+	unsigned int target;
+
+	atomic_t completions;
+	atomic_long_t progress;
+	unsigned int rate;
+	unsigned long overflows;
 };
 
 struct xone_dongle {
 	struct xone_mt76 mt;
 
-	struct usb_anchor urbs_in_idle;
-	struct usb_anchor urbs_in_busy;
-	struct usb_anchor urbs_out_idle;
-	struct usb_anchor urbs_out_busy;
+	/* deferred radio bring-up */
+	struct work_struct init_work;
+	struct completion init_done;
+	int init_err;
+	bool resetting;
+	bool releasing;
+	bool ready;
+
+	struct xone_dongle_rx_pool rx_cmd;
+	struct xone_dongle_rx_pool rx_wlan;
+	struct delayed_work rx_tune_work;
+
+	/* background channel survey */
+	struct delayed_work survey_work;
+
+	/* TX status and client statistics */
+	struct delayed_work stats_work;
+	unsigned int stats_runs;
+
+	/* audio must never delay input-related traffic */
+	struct xone_dongle_tx_pool tx_data;
+	struct xone_dongle_tx_pool tx_audio;
 
 	/* serializes pairing changes */
 	struct mutex pairing_lock;
@@ -79,12 +269,140 @@ struct xone_dongle {
 	/* serializes access to clients array */
 	spinlock_t clients_lock;
 	struct xone_dongle_client *clients[XONE_DONGLE_MAX_CLIENTS];
+	struct xone_dongle_assoc_stats assoc_stats[XONE_DONGLE_MAX_CLIENTS];
 	atomic_t client_count;
 	wait_queue_head_t disconnect_wait;
 
+	/* clients that have not disassociated after power off */
+	unsigned long pwr_off_pending;
+	bool draining;
+	s64 pwr_off_ms;
+	unsigned int pwr_off_timeouts;
+
+	/* associations of different clients run concurrently */
+	struct workqueue_struct *assoc_wq;
+
 	struct workqueue_struct *event_wq;
+	struct work_struct event_work;
+
+	/* multi-producer, single-consumer ring */
+	struct xone_dongle_event events[XONE_DONGLE_NUM_EVENTS];
+	atomic_t events_head;
+	unsigned int events_tail;
+
+	atomic_long_t events_produced;
+	atomic_long_t events_overflows;
+	atomic_t events_high_water;
+
+	/* WLAN frame decode statistics, timing only with rx_timing */
+	atomic_long_t rx_frames;
+	atomic_long_t rx_padded;
+	atomic64_t rx_time_ns;
+	atomic64_t rx_max_ns;
+
+	/* firmware crash handling, runs on event_wq */
+	struct sk_buff_head coredump_skbs;
+	struct delayed_work coredump_work;
+	unsigned int coredumps;
+	unsigned int recoveries;
+	unsigned int recovery_failures;
+	s64 recovery_ms;
+
+	/* clients lost by a firmware reload on resume, runs on event_wq */
+	struct work_struct restore_work;
+
+	/* escalating recovery from RX or MCU stalls, runs on event_wq */
+	struct delayed_work watchdog_work;
+	enum xone_dongle_recovery {
+		XONE_DONGLE_RECOVER_URBS,
+		XONE_DONGLE_RECOVER_RADIO,
+		XONE_DONGLE_RECOVER_FIRMWARE,
+		XONE_DONGLE_RECOVER_USB,
+		XONE_DONGLE_NUM_RECOVERY_STEPS,
+	} watchdog_step;
+	unsigned int watchdog_stalls;
+	long watchdog_progress;
+	unsigned long watchdog_tx;
+	unsigned int watchdog_timeouts;
+	bool watchdog_hard;
+	unsigned int watchdog_counts[XONE_DONGLE_NUM_RECOVERY_STEPS];
+
+	/* runtime PM reference held for connected clients */
+	struct mutex pm_lock;
+	struct work_struct pm_work;
+	bool pm_hold;
+	bool asleep;
+	unsigned int idle_suspends;
+	struct ewma_xone_latency resume_latency;
+	s64 resume_us;
+
+	/* entry in xone_dongle_list */
+	struct list_head node;
+
+	/* channel seen by other dongles, protected by xone_dongle_list_lock */
+	struct xone_mt76_channel *channel;
+
+	struct dentry *debugfs;
 };
 
+static struct dentry *xone_dongle_debugfs_root;
+
+/* all dongles on this host, protects their published channels */
+static LIST_HEAD(xone_dongle_list);
+static DEFINE_MUTEX(xone_dongle_list_lock);
+
+static unsigned int rx_urbs_min = 2;
+module_param(rx_urbs_min, uint, 0644);
+MODULE_PARM_DESC(rx_urbs_min, "Minimum number of bulk-in URBs per endpoint");
+
+static unsigned int rx_urbs_max = 12;
+module_param(rx_urbs_max, uint, 0644);
+MODULE_PARM_DESC(rx_urbs_max, "Maximum number of bulk-in URBs per endpoint");
+
+static unsigned int rx_wlan_buf_len = XONE_DONGLE_LEN_WLAN_PKT;
+module_param(rx_wlan_buf_len, uint, 0444);
+MODULE_PARM_DESC(rx_wlan_buf_len, "Buffer length of WLAN bulk-in URBs");
+
+static unsigned int survey_interval;
+module_param(survey_interval, uint, 0644);
+MODULE_PARM_DESC(survey_interval, "Channel survey interval in seconds (0 = off)");
+
+static bool channel_migration;
+module_param(channel_migration, bool, 0644);
+MODULE_PARM_DESC(channel_migration, "Move connected clients to better channels");
+
+static bool client_stats;
+module_param(client_stats, bool, 0644);
+MODULE_PARM_DESC(client_stats, "Request link statistics from clients");
+
+static bool tx_adaptation;
+module_param(tx_adaptation, bool, 0644);
+MODULE_PARM_DESC(tx_adaptation, "Adapt TX rate and retry limits to link quality");
+
+static bool balance_pairing;
+module_param(balance_pairing, bool, 0644);
+MODULE_PARM_DESC(balance_pairing, "Enable pairing on the least loaded dongle");
+
+static bool rx_timing;
+module_param(rx_timing, bool, 0644);
+MODULE_PARM_DESC(rx_timing, "Measure WLAN frame decode time");
+
+static bool watchdog = true;
+module_param(watchdog, bool, 0644);
+MODULE_PARM_DESC(watchdog, "Recover from stalled RX and MCU commands");
+
+static unsigned int idle_timeout = 60;
+module_param(idle_timeout, uint, 0444);
+MODULE_PARM_DESC(idle_timeout, "Autosuspend delay without input in seconds");
+
+static bool idle_suspend;
+module_param(idle_suspend, bool, 0644);
+MODULE_PARM_DESC(idle_suspend, "Autosuspend with idle clients connected");
+
+static unsigned int resume_budget = 20;
+module_param(resume_budget, uint, 0644);
+MODULE_PARM_DESC(resume_budget, "Maximum resume latency for idle suspend in ms");
+
 static void xone_dongle_prep_packet(struct xone_dongle_client *client,
 				    struct sk_buff *skb,
 				    enum xone_dongle_queue queue)
@@ -94,6 +412,10 @@ static void xone_dongle_prep_packet(struct xone_dongle_client *client,
 	u8 data[] = {
 		0x00, 0x00, queue, client->wcid - 1, 0x00, 0x00, 0x00, 0x00,
 	};
+	u8 rate = 0;
+
+	if (READ_ONCE(tx_adaptation))
+		rate = READ_ONCE(client->rate.index);
 
 	/* frame is sent from AP (DS) */
 	/* duration is the time required to transmit (in μs) */
@@ -113,7 +435,8 @@ static void xone_dongle_prep_packet(struct xone_dongle_client *client,
 	/* wait for acknowledgment */
 	txwi.flags = cpu_to_le16(FIELD_PREP(MT_TXWI_FLAGS_MPDU_DENSITY,
 					    IEEE80211_HT_MPDU_DENSITY_4));
-	txwi.rate = cpu_to_le16(FIELD_PREP(MT_RXWI_RATE_PHY, MT_PHY_TYPE_OFDM));
+	txwi.rate = cpu_to_le16(FIELD_PREP(MT_RXWI_RATE_PHY, MT_PHY_TYPE_OFDM) |
+				FIELD_PREP(MT_RXWI_RATE_INDEX, rate));
 	txwi.ack_ctl = MT_TXWI_ACK_CTL_REQ;
 	txwi.wcid = client->wcid - 1;
 	txwi.len_ctl = cpu_to_le16(sizeof(hdr) + skb->len);
@@ -126,18 +449,167 @@ static void xone_dongle_prep_packet(struct xone_dongle_client *client,
 	xone_mt76_prep_command(skb, 0);
 }
 
+static struct sk_buff *
+xone_dongle_tx_dequeue(struct xone_dongle_tx_pool *pool,
+		       struct xone_dongle_tx_queue **queue)
+{
+	struct xone_dongle_tx_queue *txq;
+	struct sk_buff *skb;
+
+	/* deficit round-robin across all clients with queued packets */
+	while (!list_empty(&pool->active)) {
+		txq = list_first_entry(&pool->active, typeof(*txq), node);
+		skb = skb_peek(&txq->skbs);
+
+		if (skb->len > txq->deficit) {
+			txq->deficit += XONE_DONGLE_TX_QUANTUM;
+			list_move_tail(&txq->node, &pool->active);
+			continue;
+		}
+
+		__skb_unlink(skb, &txq->skbs);
+		txq->deficit -= skb->len;
+		txq->packets++;
+		txq->bytes += skb->len;
+
+		/* inactive clients do not accumulate credit */
+		if (skb_queue_empty(&txq->skbs)) {
+			list_del_init(&txq->node);
+			txq->deficit = 0;
+		}
+
+		*queue = txq;
+
+		return skb;
+	}
+
+	return NULL;
+}
+
+static void xone_dongle_tx_schedule(struct xone_dongle *dongle,
+				    struct xone_dongle_tx_pool *pool)
+{
+	struct xone_dongle_tx_queue *txq;
+	struct sk_buff *skb;
+	struct urb *urb;
+	int err;
+
+	lockdep_assert_held(&pool->lock);
+
+	while (!list_empty(&pool->active)) {
+		urb = usb_get_from_anchor(&pool->urbs_idle);
+		if (!urb)
+			break;
+
+		skb = xone_dongle_tx_dequeue(pool, &txq);
+		urb->context = skb;
+		urb->transfer_buffer = skb->data;
+		urb->transfer_buffer_length = skb->len;
+		usb_anchor_urb(urb, &pool->urbs_busy);
+
+		err = usb_submit_urb(urb, GFP_ATOMIC);
+		if (err) {
+			usb_unanchor_urb(urb);
+			usb_anchor_urb(urb, &pool->urbs_idle);
+
+			/* count the packet as dropped instead of sent */
+			txq->packets--;
+			txq->bytes -= skb->len;
+			txq->drops++;
+			dev_kfree_skb_any(skb);
+		}
+
+		usb_free_urb(urb);
+
+		/* can fail during USB device removal */
+		if (err) {
+			dev_dbg(dongle->mt.dev, "%s: submit failed: %d\n",
+				__func__, err);
+			break;
+		}
+	}
+}
+
+static int xone_dongle_queue_packet(struct xone_dongle *dongle,
+				    struct xone_dongle_tx_pool *pool,
+				    u8 wcid, struct sk_buff *skb)
+{
+	struct xone_dongle_tx_queue *txq = &pool->queues[wcid - 1];
+	struct xone_dongle_skb_cb *cb = (struct xone_dongle_skb_cb *)skb->cb;
+	unsigned long flags;
+
+	cb->pool = pool;
+
+	spin_lock_irqsave(&pool->lock, flags);
+
+	if (skb_queue_len(&txq->skbs) >= XONE_DONGLE_TX_QUEUE_LEN) {
+		txq->drops++;
+		spin_unlock_irqrestore(&pool->lock, flags);
+		dev_kfree_skb_any(skb);
+		return -ENOSPC;
+	}
+
+	__skb_queue_tail(&txq->skbs, skb);
+	txq->max_depth = max(txq->max_depth, skb_queue_len(&txq->skbs));
+
+	if (list_empty(&txq->node))
+		list_add_tail(&txq->node, &pool->active);
+
+	if (!pool->plugged)
+		xone_dongle_tx_schedule(dongle, pool);
+
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	return 0;
+}
+
+/* nests, packets get submitted once every plug has been removed */
+static void xone_dongle_plug_tx(struct xone_dongle *dongle,
+				struct xone_dongle_tx_pool *pool, bool plug)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->lock, flags);
+
+	if (plug)
+		pool->plugged++;
+	else if (!--pool->plugged)
+		xone_dongle_tx_schedule(dongle, pool);
+
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+static void xone_dongle_reset_tx_queue(struct xone_dongle_tx_pool *pool,
+				       u8 wcid)
+{
+	struct xone_dongle_tx_queue *txq = &pool->queues[wcid - 1];
+	struct sk_buff_head skbs;
+	unsigned long flags;
+
+	__skb_queue_head_init(&skbs);
+
+	spin_lock_irqsave(&pool->lock, flags);
+
+	list_del_init(&txq->node);
+	skb_queue_splice_init(&txq->skbs, &skbs);
+	txq->deficit = 0;
+	txq->packets = 0;
+	txq->bytes = 0;
+	txq->drops = 0;
+	txq->max_depth = 0;
+
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	__skb_queue_purge(&skbs);
+}
+
 static int xone_dongle_get_buffer(struct gip_adapter *adap,
 				  struct gip_adapter_buffer *buf)
 {
 	struct xone_dongle_client *client = dev_get_drvdata(&adap->dev);
 	struct xone_dongle_skb_cb *cb;
-	struct urb *urb;
 	struct sk_buff *skb;
 
-	urb = usb_get_from_anchor(&client->dongle->urbs_out_idle);
-	if (!urb)
-		return -ENOSPC;
-
 	skb = xone_mt76_alloc_message(XONE_DONGLE_LEN_CMD_PKT, GFP_ATOMIC);
 	if (!skb)
 		return -ENOMEM;
@@ -149,7 +621,6 @@ static int xone_dongle_get_buffer(struct gip_adapter *adap,
 
 	cb = (struct xone_dongle_skb_cb *)skb->cb;
 	cb->dongle = client->dongle;
-	cb->urb = urb;
 
 	buf->context = skb;
 	buf->data = skb->data;
@@ -162,44 +633,53 @@ static int xone_dongle_submit_buffer(struct gip_adapter *adap,
 				     struct gip_adapter_buffer *buf)
 {
 	struct xone_dongle_client *client = dev_get_drvdata(&adap->dev);
-	struct xone_dongle_skb_cb *cb;
+	struct xone_dongle *dongle = client->dongle;
+	struct usb_interface *intf = to_usb_interface(dongle->mt.dev);
+	struct xone_dongle_tx_pool *pool;
 	struct sk_buff *skb = buf->context;
-	int err;
 
-	skb_put(skb, buf->length);
+	/* wake up idle dongle, packet gets dropped */
+	if (READ_ONCE(dongle->asleep)) {
+		dev_kfree_skb_any(skb);
+		if (!usb_autopm_get_interface_async(intf))
+			usb_autopm_put_interface_async(intf);
 
-	if (buf->type == GIP_BUF_DATA)
-		xone_dongle_prep_packet(client, skb, XONE_DONGLE_QUEUE_DATA);
-	else if (buf->type == GIP_BUF_AUDIO)
-		xone_dongle_prep_packet(client, skb, XONE_DONGLE_QUEUE_AUDIO);
-	else
-		return -EINVAL;
+		return -EAGAIN;
+	}
 
-	cb = (struct xone_dongle_skb_cb *)skb->cb;
-	cb->urb->context = skb;
-	cb->urb->transfer_buffer = skb->data;
-	cb->urb->transfer_buffer_length = skb->len;
-	usb_anchor_urb(cb->urb, &client->dongle->urbs_out_busy);
+	usb_mark_last_busy(dongle->mt.udev);
 
-	err = usb_submit_urb(cb->urb, GFP_ATOMIC);
-	if (err) {
-		usb_unanchor_urb(cb->urb);
-		usb_anchor_urb(cb->urb, &client->dongle->urbs_out_idle);
+	if (buf->type == GIP_BUF_DATA) {
+		pool = &client->dongle->tx_data;
+	} else if (buf->type == GIP_BUF_AUDIO) {
+		pool = &client->dongle->tx_audio;
+	} else {
 		dev_kfree_skb_any(skb);
+		return -EINVAL;
 	}
 
-	usb_free_urb(cb->urb);
+	skb_put(skb, buf->length);
+	xone_dongle_prep_packet(client, skb, pool->queue);
 
-	return err;
+	return xone_dongle_queue_packet(client->dongle, pool,
+					client->wcid, skb);
 }
 
 static int xone_dongle_set_encryption_key(struct gip_adapter *adap,
 					  u8 *key, int len)
 {
 	struct xone_dongle_client *client = dev_get_drvdata(&adap->dev);
+	int err;
+
+	err = xone_mt76_set_client_key(&client->dongle->mt, client->wcid,
+				       key, len);
+	if (err)
+		return err;
 
-	return xone_mt76_set_client_key(&client->dongle->mt, client->wcid,
-					key, len);
+	memcpy(client->key, key, len);
+	client->key_valid = true;
+
+	return 0;
 }
 
 static struct gip_adapter_ops xone_dongle_adapter_ops = {
@@ -214,6 +694,14 @@ static int xone_dongle_toggle_pairing(struct xone_dongle *dongle, bool enable)
 	enum xone_mt76_led_mode led;
 	int err = 0;
 
+	/* balanced pairing can target an autosuspended dongle */
+	/* suspend waits for pairing_lock holders, resume outside of it */
+	if (enable) {
+		err = usb_autopm_get_interface(intf);
+		if (err)
+			return err;
+	}
+
 	mutex_lock(&dongle->pairing_lock);
 
 	/* pairing is already enabled/disabled */
@@ -235,17 +723,22 @@ static int xone_dongle_toggle_pairing(struct xone_dongle *dongle, bool enable)
 	if (err)
 		goto err_unlock;
 
-	if (enable)
-		usb_autopm_get_interface(intf);
-	else
-		usb_autopm_put_interface(intf);
-
 	dev_dbg(dongle->mt.dev, "%s: enabled=%d\n", __func__, enable);
 	dongle->pairing = enable;
+	mutex_unlock(&dongle->pairing_lock);
+
+	/* reference is held while pairing is enabled */
+	if (!enable)
+		usb_autopm_put_interface(intf);
+
+	return 0;
 
 err_unlock:
 	mutex_unlock(&dongle->pairing_lock);
 
+	if (enable)
+		usb_autopm_put_interface(intf);
+
 	return err;
 }
 
@@ -262,111 +755,285 @@ static void xone_dongle_pairing_timeout(struct work_struct *work)
 			__func__, err);
 }
 
-static struct xone_dongle_client *
-xone_dongle_create_client(struct xone_dongle *dongle, u8 *addr)
+static bool xone_dongle_may_idle(struct xone_dongle *dongle)
 {
-	struct xone_dongle_client *client;
-	int i, err;
+	unsigned long latency = ewma_xone_latency_read(&dongle->resume_latency);
 
-	/* find free WCID */
-	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++)
-		if (!dongle->clients[i])
-			break;
+	/* never trade input lag for power */
+	return idle_suspend && latency <= resume_budget * USEC_PER_MSEC;
+}
 
-	if (i == XONE_DONGLE_MAX_CLIENTS)
-		return ERR_PTR(-ENOSPC);
+/* clients without input let the autosuspend timer expire */
+static bool xone_dongle_want_hold(struct xone_dongle *dongle)
+{
+	return atomic_read(&dongle->client_count) &&
+	       !xone_dongle_may_idle(dongle);
+}
 
-	client = kzalloc(sizeof(*client), GFP_KERNEL);
-	if (!client)
-		return ERR_PTR(-ENOMEM);
+static void xone_dongle_update_pm(struct xone_dongle *dongle)
+{
+	struct usb_interface *intf = to_usb_interface(dongle->mt.dev);
+	bool hold;
+	int err;
 
-	client->dongle = dongle;
-	client->wcid = i + 1;
-	memcpy(client->address, addr, ETH_ALEN);
+	mutex_lock(&dongle->pm_lock);
 
-	client->adapter = gip_create_adapter(dongle->mt.dev,
-					     &xone_dongle_adapter_ops, 1);
-	if (IS_ERR(client->adapter)) {
-		err = PTR_ERR(client->adapter);
-		kfree(client);
-		return ERR_PTR(err);
+	hold = xone_dongle_want_hold(dongle);
+	if (hold == dongle->pm_hold)
+		goto err_unlock;
+
+	if (hold) {
+		err = usb_autopm_get_interface(intf);
+		if (err) {
+			dev_err(dongle->mt.dev, "%s: get failed: %d\n",
+				__func__, err);
+			goto err_unlock;
+		}
+	} else {
+		usb_autopm_put_interface(intf);
 	}
 
-	dev_set_drvdata(&client->adapter->dev, client);
+	dev_dbg(dongle->mt.dev, "%s: hold=%d\n", __func__, hold);
+	dongle->pm_hold = hold;
+
+err_unlock:
+	mutex_unlock(&dongle->pm_lock);
+}
+
+static void xone_dongle_pm_work(struct work_struct *work)
+{
+	struct xone_dongle *dongle = container_of(work, typeof(*dongle),
+						  pm_work);
 
-	return client;
+	xone_dongle_update_pm(dongle);
 }
 
-static int xone_dongle_add_client(struct xone_dongle *dongle, u8 *addr)
+static void xone_dongle_push_event(struct xone_dongle *dongle,
+				   enum xone_dongle_event_type type,
+				   u8 wcid, u8 *addr)
 {
-	struct xone_dongle_client *client;
-	int err;
+	struct xone_dongle_event *slot;
+	int pos, seq, depth, high_water;
+
+	pos = atomic_read(&dongle->events_head);
+
+	/* claim a free slot, called concurrently from URB completions */
+	for (;;) {
+		slot = &dongle->events[pos & (XONE_DONGLE_NUM_EVENTS - 1)];
+		seq = atomic_read_acquire(&slot->seq);
+
+		if (seq == pos) {
+			if (atomic_try_cmpxchg(&dongle->events_head, &pos,
+					       pos + 1))
+				break;
+		} else if (seq - pos < 0) {
+			atomic_long_inc(&dongle->events_overflows);
+			dev_warn_ratelimited(dongle->mt.dev,
+					     "%s: event ring full, type=%d\n",
+					     __func__, type);
+			return;
+		} else {
+			pos = atomic_read(&dongle->events_head);
+		}
+	}
+
+	slot->type = type;
+	slot->wcid = wcid;
+	slot->time = ktime_get();
+
+	if (addr)
+		memcpy(slot->address, addr, ETH_ALEN);
+	else
+		memset(slot->address, 0, ETH_ALEN);
+
+	atomic_set_release(&slot->seq, pos + 1);
+	atomic_long_inc(&dongle->events_produced);
+
+	depth = pos + 1 - READ_ONCE(dongle->events_tail);
+	high_water = atomic_read(&dongle->events_high_water);
+
+	while (depth > high_water &&
+	       !atomic_try_cmpxchg(&dongle->events_high_water, &high_water,
+				   depth))
+		;
+
+	queue_work(dongle->event_wq, &dongle->event_work);
+}
+
+static void xone_dongle_record_assoc(struct xone_dongle *dongle, u8 wcid,
+				     struct xone_dongle_assoc_stats *stats)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dongle->clients_lock, flags);
+	dongle->assoc_stats[wcid - 1] = *stats;
+	spin_unlock_irqrestore(&dongle->clients_lock, flags);
+}
+
+static void xone_dongle_associate(struct work_struct *work)
+{
+	struct xone_dongle_client *client = container_of(work, typeof(*client),
+							 assoc_work);
+	struct xone_dongle *dongle = client->dongle;
+	struct xone_dongle_assoc_stats stats = {};
+	struct gip_adapter *adap;
+	ktime_t start, now;
 	unsigned long flags;
+	int err;
+
+	memcpy(stats.address, client->address, ETH_ALEN);
+	start = ktime_get();
+	stats.queue_us = ktime_us_delta(start, client->assoc_time);
+
+	adap = gip_create_adapter(dongle->mt.dev, &xone_dongle_adapter_ops, 1);
+	if (IS_ERR(adap)) {
+		err = PTR_ERR(adap);
+		goto err_remove_client;
+	}
 
-	client = xone_dongle_create_client(dongle, addr);
-	if (IS_ERR(client))
-		return PTR_ERR(client);
+	dev_set_drvdata(&adap->dev, client);
 
-	err = xone_mt76_associate_client(&dongle->mt, client->wcid, addr);
+	now = ktime_get();
+	stats.adapter_us = ktime_us_delta(now, start);
+	start = now;
+
+	err = xone_mt76_associate_client(&dongle->mt, client->wcid,
+					 client->address);
 	if (err)
-		goto err_free_client;
+		goto err_destroy_adapter;
+
+	now = ktime_get();
+	stats.associate_us = ktime_us_delta(now, start);
+	start = now;
 
 	if (!dongle->pairing) {
 		err = xone_mt76_set_led_mode(&dongle->mt, XONE_MT_LED_ON);
 		if (err)
-			goto err_free_client;
+			goto err_destroy_adapter;
 	}
 
-	dev_dbg(dongle->mt.dev, "%s: wcid=%d, address=%pM\n",
-		__func__, client->wcid, addr);
+	now = ktime_get();
+	stats.led_us = ktime_us_delta(now, start);
+	stats.total_us = ktime_us_delta(now, client->assoc_time);
+	xone_dongle_record_assoc(dongle, client->wcid, &stats);
+
+	dev_dbg(dongle->mt.dev, "%s: wcid=%d, address=%pM, time=%lldus\n",
+		__func__, client->wcid, client->address, stats.total_us);
 
 	spin_lock_irqsave(&dongle->clients_lock, flags);
-	dongle->clients[client->wcid - 1] = client;
+	client->adapter = adap;
 	spin_unlock_irqrestore(&dongle->clients_lock, flags);
 
+	client->associated = true;
 	atomic_inc(&dongle->client_count);
-	usb_autopm_get_interface(to_usb_interface(dongle->mt.dev));
+	usb_mark_last_busy(dongle->mt.udev);
+	xone_dongle_update_pm(dongle);
 
-	return 0;
+	return;
 
-err_free_client:
-	gip_destroy_adapter(client->adapter);
-	kfree(client);
+err_destroy_adapter:
+	gip_destroy_adapter(adap);
+err_remove_client:
+	stats.err = err;
+	xone_dongle_record_assoc(dongle, client->wcid, &stats);
 
-	return err;
+	dev_err(dongle->mt.dev, "%s: associate failed: %d\n", __func__, err);
+
+	/* WCID gets released by the event worker */
+	xone_dongle_push_event(dongle, XONE_DONGLE_EVT_REMOVE_CLIENT,
+			       client->wcid, NULL);
 }
 
-static int xone_dongle_remove_client(struct xone_dongle *dongle, u8 wcid)
+static int xone_dongle_add_client(struct xone_dongle *dongle, u8 *addr,
+				  ktime_t time)
 {
 	struct xone_dongle_client *client;
-	int err;
 	unsigned long flags;
+	int i;
 
-	client = dongle->clients[wcid - 1];
-	if (!client)
+	/* clients are being powered off */
+	if (READ_ONCE(dongle->draining)) {
+		dev_dbg(dongle->mt.dev, "%s: draining, address=%pM\n",
+			__func__, addr);
 		return 0;
+	}
 
-	dev_dbg(dongle->mt.dev, "%s: wcid=%d, address=%pM\n",
-		__func__, wcid, client->address);
-
-	spin_lock_irqsave(&dongle->clients_lock, flags);
-	dongle->clients[wcid - 1] = NULL;
-	spin_unlock_irqrestore(&dongle->clients_lock, flags);
+	/* find free WCID */
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++)
+		if (!dongle->clients[i])
+			break;
 
-	gip_destroy_adapter(client->adapter);
-	kfree(client);
+	if (i == XONE_DONGLE_MAX_CLIENTS)
+		return -ENOSPC;
 
-	err = xone_mt76_remove_client(&dongle->mt, wcid);
+	client = kzalloc(sizeof(*client), GFP_KERNEL);
+	if (!client)
+		return -ENOMEM;
+
+	client->dongle = dongle;
+	client->wcid = i + 1;
+	client->assoc_time = time;
+	memcpy(client->address, addr, ETH_ALEN);
+	INIT_WORK(&client->assoc_work, xone_dongle_associate);
+	ewma_xone_rssi_init(&client->link.rssi_avg);
+
+	/* reserve WCID, adapter gets published once associated */
+	spin_lock_irqsave(&dongle->clients_lock, flags);
+	dongle->clients[i] = client;
+	spin_unlock_irqrestore(&dongle->clients_lock, flags);
+
+	queue_work(dongle->assoc_wq, &client->assoc_work);
+
+	return 0;
+}
+
+static int xone_dongle_remove_client(struct xone_dongle *dongle, u8 wcid)
+{
+	struct xone_dongle_client *client;
+	bool associated;
+	int err;
+	unsigned long flags;
+
+	client = dongle->clients[wcid - 1];
+	if (!client)
+		return 0;
+
+	/* wait for pending association */
+	flush_work(&client->assoc_work);
+
+	dev_dbg(dongle->mt.dev, "%s: wcid=%d, address=%pM\n",
+		__func__, wcid, client->address);
+
+	spin_lock_irqsave(&dongle->clients_lock, flags);
+	dongle->clients[wcid - 1] = NULL;
+	spin_unlock_irqrestore(&dongle->clients_lock, flags);
+
+	clear_bit(wcid - 1, &dongle->pwr_off_pending);
+	associated = client->associated;
+
+	if (client->adapter)
+		gip_destroy_adapter(client->adapter);
+
+	kfree(client);
+
+	/* drop packets that have not been sent yet */
+	xone_dongle_reset_tx_queue(&dongle->tx_data, wcid);
+	xone_dongle_reset_tx_queue(&dongle->tx_audio, wcid);
+
+	err = xone_mt76_remove_client(&dongle->mt, wcid);
 	if (err)
 		dev_err(dongle->mt.dev, "%s: remove failed: %d\n",
 			__func__, err);
 
+	if (!associated)
+		return err;
+
 	/* turn off LED if all clients have disconnected */
 	if (atomic_dec_and_test(&dongle->client_count) && !dongle->pairing)
 		err = xone_mt76_set_led_mode(&dongle->mt, XONE_MT_LED_OFF);
 
 	wake_up(&dongle->disconnect_wait);
-	usb_autopm_put_interface(to_usb_interface(dongle->mt.dev));
+	xone_dongle_update_pm(dongle);
 
 	return err;
 }
@@ -409,58 +1076,159 @@ static int xone_dongle_enable_client_encryption(struct xone_dongle *dongle,
 	return 0;
 }
 
-static void xone_dongle_handle_event(struct work_struct *work)
+static unsigned int xone_dongle_get_load(struct xone_dongle *dongle)
+{
+	struct xone_mt76 *mt = &dongle->mt;
+	unsigned int load;
+
+	lockdep_assert_held(&xone_dongle_list_lock);
+
+	load = atomic_read(&dongle->client_count) * XONE_DONGLE_CLIENT_LOAD;
+	if (dongle->channel)
+		load += READ_ONCE(mt->survey[dongle->channel -
+					     mt->channels].score);
+
+	return load;
+}
+
+static void xone_dongle_balance_pairing(struct xone_dongle *dongle)
+{
+	struct xone_dongle *other, *target = dongle;
+	unsigned int load, min_load;
+
+	mutex_lock(&xone_dongle_list_lock);
+
+	min_load = xone_dongle_get_load(dongle);
+
+	list_for_each_entry(other, &xone_dongle_list, node) {
+		if (other == dongle || !smp_load_acquire(&other->ready) ||
+		    atomic_read(&other->client_count) >=
+		    XONE_DONGLE_MAX_CLIENTS)
+			continue;
+
+		load = xone_dongle_get_load(other);
+		if (load < min_load) {
+			target = other;
+			min_load = load;
+		}
+	}
+
+	dev_dbg(dongle->mt.dev, "%s: target=%s, load=%u\n", __func__,
+		dev_name(target->mt.dev), min_load);
+
+	/* removal from the list flushes the target's events */
+	xone_dongle_push_event(target, XONE_DONGLE_EVT_OPEN_PAIRING, 0, NULL);
+
+	mutex_unlock(&xone_dongle_list_lock);
+}
+
+static int xone_dongle_open_pairing(struct xone_dongle *dongle)
+{
+	mod_delayed_work(system_wq, &dongle->pairing_work,
+			 XONE_DONGLE_PAIRING_TIMEOUT);
+
+	return xone_dongle_toggle_pairing(dongle, true);
+}
+
+static void xone_dongle_handle_event(struct xone_dongle *dongle,
+				     struct xone_dongle_event *evt)
 {
-	struct xone_dongle_event *evt = container_of(work, typeof(*evt), work);
 	int err = 0;
 
 	switch (evt->type) {
 	case XONE_DONGLE_EVT_ADD_CLIENT:
-		err = xone_dongle_add_client(evt->dongle, evt->address);
+		err = xone_dongle_add_client(dongle, evt->address, evt->time);
 		break;
 	case XONE_DONGLE_EVT_REMOVE_CLIENT:
-		err = xone_dongle_remove_client(evt->dongle, evt->wcid);
+		err = xone_dongle_remove_client(dongle, evt->wcid);
 		break;
 	case XONE_DONGLE_EVT_PAIR_CLIENT:
-		err = xone_dongle_pair_client(evt->dongle, evt->address);
+		err = xone_dongle_pair_client(dongle, evt->address);
 		break;
 	case XONE_DONGLE_EVT_ENABLE_PAIRING:
-		mod_delayed_work(system_wq, &evt->dongle->pairing_work,
-				 XONE_DONGLE_PAIRING_TIMEOUT);
-		err = xone_dongle_toggle_pairing(evt->dongle, true);
+		if (READ_ONCE(balance_pairing))
+			xone_dongle_balance_pairing(dongle);
+		else
+			err = xone_dongle_open_pairing(dongle);
+		break;
+	case XONE_DONGLE_EVT_OPEN_PAIRING:
+		err = xone_dongle_open_pairing(dongle);
 		break;
 	case XONE_DONGLE_EVT_ENABLE_ENCRYPTION:
-		err = xone_dongle_enable_client_encryption(evt->dongle,
-							   evt->wcid);
+		err = xone_dongle_enable_client_encryption(dongle, evt->wcid);
 		break;
 	}
 
 	if (err)
-		dev_err(evt->dongle->mt.dev, "%s: handle event failed: %d\n",
+		dev_err(dongle->mt.dev, "%s: handle event failed: %d\n",
 			__func__, err);
+}
+
+static void xone_dongle_process_events(struct work_struct *work)
+{
+	struct xone_dongle *dongle = container_of(work, typeof(*dongle),
+						  event_work);
+	struct xone_dongle_event *slot, evt;
+	unsigned int tail = dongle->events_tail;
+
+	for (;;) {
+		slot = &dongle->events[tail & (XONE_DONGLE_NUM_EVENTS - 1)];
+
+		/* slot has not been published yet */
+		if (atomic_read_acquire(&slot->seq) != tail + 1)
+			break;
+
+		evt = *slot;
+
+		/* hand slot back to producers for the next lap */
+		atomic_set_release(&slot->seq, tail + XONE_DONGLE_NUM_EVENTS);
+		WRITE_ONCE(dongle->events_tail, ++tail);
+
+		xone_dongle_handle_event(dongle, &evt);
+	}
+}
+
+static void xone_dongle_init_events(struct xone_dongle *dongle)
+{
+	int i;
 
-	kfree(evt);
+	for (i = 0; i < XONE_DONGLE_NUM_EVENTS; i++)
+		atomic_set(&dongle->events[i].seq, i);
+
+	INIT_WORK(&dongle->event_work, xone_dongle_process_events);
+}
+
+static void xone_dongle_update_link(struct xone_dongle_client *client, s8 rssi)
+{
+	client->link.rx_frames++;
+	client->link.rssi = rssi;
+
+	/* skip samples from corrupt or saturated RXWIs */
+	if (rssi < 0)
+		ewma_xone_rssi_add(&client->link.rssi_avg,
+				   -max_t(int, rssi, -127));
 }
 
-static struct xone_dongle_event *
-xone_dongle_alloc_event(struct xone_dongle *dongle,
-			enum xone_dongle_event_type type)
+static void xone_dongle_update_rx_stats(struct xone_dongle *dongle,
+					u8 wcid, s8 rssi)
 {
-	struct xone_dongle_event *evt;
+	struct xone_dongle_client *client;
+	unsigned long flags;
+
+	if (!wcid || wcid > XONE_DONGLE_MAX_CLIENTS)
+		return;
 
-	evt = kzalloc(sizeof(*evt), GFP_ATOMIC);
-	if (!evt)
-		return NULL;
+	spin_lock_irqsave(&dongle->clients_lock, flags);
 
-	evt->type = type;
-	evt->dongle = dongle;
-	INIT_WORK(&evt->work, xone_dongle_handle_event);
+	client = dongle->clients[wcid - 1];
+	if (client)
+		xone_dongle_update_link(client, rssi);
 
-	return evt;
+	spin_unlock_irqrestore(&dongle->clients_lock, flags);
 }
 
 static int xone_dongle_handle_qos_data(struct xone_dongle *dongle,
-				       struct sk_buff *skb, u8 wcid)
+				       struct sk_buff *skb, u8 wcid, s8 rssi)
 {
 	struct xone_dongle_client *client;
 	int err = 0;
@@ -473,7 +1241,13 @@ static int xone_dongle_handle_qos_data(struct xone_dongle *dongle,
 
 	client = dongle->clients[wcid - 1];
 	if (client)
-		err = gip_process_buffer(client->adapter, skb->data, skb->len);
+		xone_dongle_update_link(client, rssi);
+
+	if (client && client->adapter) {
+		usb_mark_last_busy(dongle->mt.udev);
+		err = gip_process_buffer(client->adapter, skb->data, skb->len,
+					 skb->tstamp);
+	}
 
 	spin_unlock_irqrestore(&dongle->clients_lock, flags);
 
@@ -482,34 +1256,45 @@ static int xone_dongle_handle_qos_data(struct xone_dongle *dongle,
 
 static int xone_dongle_handle_association(struct xone_dongle *dongle, u8 *addr)
 {
-	struct xone_dongle_event *evt;
+	xone_dongle_push_event(dongle, XONE_DONGLE_EVT_ADD_CLIENT, 0, addr);
 
-	evt = xone_dongle_alloc_event(dongle, XONE_DONGLE_EVT_ADD_CLIENT);
-	if (!evt)
-		return -ENOMEM;
+	return 0;
+}
 
-	memcpy(evt->address, addr, ETH_ALEN);
+static int xone_dongle_handle_disassociation(struct xone_dongle *dongle,
+					     u8 wcid)
+{
+	if (!wcid || wcid > XONE_DONGLE_MAX_CLIENTS)
+		return 0;
 
-	queue_work(dongle->event_wq, &evt->work);
+	xone_dongle_push_event(dongle, XONE_DONGLE_EVT_REMOVE_CLIENT,
+			       wcid, NULL);
 
 	return 0;
 }
 
-static int xone_dongle_handle_disassociation(struct xone_dongle *dongle,
-					     u8 wcid)
+static int xone_dongle_handle_statistics(struct xone_dongle *dongle,
+					 struct sk_buff *skb, u8 wcid)
 {
-	struct xone_dongle_event *evt;
+	struct xone_dongle_client *client;
+	struct xone_dongle_link_stats *link;
+	unsigned long flags;
 
 	if (!wcid || wcid > XONE_DONGLE_MAX_CLIENTS)
 		return 0;
 
-	evt = xone_dongle_alloc_event(dongle, XONE_DONGLE_EVT_REMOVE_CLIENT);
-	if (!evt)
-		return -ENOMEM;
+	spin_lock_irqsave(&dongle->clients_lock, flags);
 
-	evt->wcid = wcid;
+	/* payload format is unknown, keep it for debugging */
+	client = dongle->clients[wcid - 1];
+	if (client) {
+		link = &client->link;
+		link->client_len = min_t(int, skb->len - 2,
+					 sizeof(link->client));
+		memcpy(link->client, skb->data + 2, link->client_len);
+	}
 
-	queue_work(dongle->event_wq, &evt->work);
+	spin_unlock_irqrestore(&dongle->clients_lock, flags);
 
 	return 0;
 }
@@ -518,7 +1303,6 @@ static int xone_dongle_handle_client_command(struct xone_dongle *dongle,
 					     struct sk_buff *skb,
 					     u8 wcid, u8 *addr)
 {
-	struct xone_dongle_event *evt;
 	enum xone_dongle_event_type evt_type;
 
 	if (skb->len < 2 || skb->data[0] != XONE_MT_WLAN_RESERVED)
@@ -528,6 +1312,8 @@ static int xone_dongle_handle_client_command(struct xone_dongle *dongle,
 	case XONE_MT_CLIENT_PAIR_REQ:
 		evt_type = XONE_DONGLE_EVT_PAIR_CLIENT;
 		break;
+	case XONE_MT_CLIENT_STATISTICS_RESP:
+		return xone_dongle_handle_statistics(dongle, skb, wcid);
 	case XONE_MT_CLIENT_ENABLE_ENCRYPTION:
 		if (!wcid || wcid > XONE_DONGLE_MAX_CLIENTS)
 			return -EINVAL;
@@ -538,27 +1324,29 @@ static int xone_dongle_handle_client_command(struct xone_dongle *dongle,
 		return 0;
 	}
 
-	evt = xone_dongle_alloc_event(dongle, evt_type);
-	if (!evt)
-		return -ENOMEM;
-
-	evt->wcid = wcid;
-	memcpy(evt->address, addr, ETH_ALEN);
-
-	queue_work(dongle->event_wq, &evt->work);
+	xone_dongle_push_event(dongle, evt_type, wcid, addr);
 
 	return 0;
 }
 
 static int xone_dongle_handle_button(struct xone_dongle *dongle)
 {
-	struct xone_dongle_event *evt;
+	xone_dongle_push_event(dongle, XONE_DONGLE_EVT_ENABLE_PAIRING, 0, NULL);
 
-	evt = xone_dongle_alloc_event(dongle, XONE_DONGLE_EVT_ENABLE_PAIRING);
-	if (!evt)
-		return -ENOMEM;
+	return 0;
+}
+
+static int xone_dongle_handle_coredump(struct xone_dongle *dongle,
+				       struct sk_buff *skb)
+{
+	if (skb_queue_len(&dongle->coredump_skbs) >=
+	    XONE_DONGLE_COREDUMP_MAX_CHUNKS)
+		return 0;
 
-	queue_work(dongle->event_wq, &evt->work);
+	/* collect chunks until the stream ends */
+	skb_queue_tail(&dongle->coredump_skbs, skb_get(skb));
+	mod_delayed_work(dongle->event_wq, &dongle->coredump_work,
+			 XONE_DONGLE_COREDUMP_TIMEOUT);
 
 	return 0;
 }
@@ -580,24 +1368,22 @@ static int xone_dongle_handle_loss(struct xone_dongle *dongle,
 	return xone_dongle_handle_disassociation(dongle, wcid);
 }
 
+/* skb only contains the payload, header stays in place before it */
 static int xone_dongle_process_frame(struct xone_dongle *dongle,
-				     struct sk_buff *skb,
-				     unsigned int hdr_len, u8 wcid)
+				     struct ieee80211_hdr_3addr *hdr,
+				     struct sk_buff *skb, u8 wcid, s8 rssi)
 {
-	struct ieee80211_hdr_3addr *hdr =
-		(struct ieee80211_hdr_3addr *)skb->data;
-	u16 type;
+	u16 type = le16_to_cpu(hdr->frame_control);
 
-	/* ignore invalid frames */
-	if (skb->len < hdr_len || hdr_len < sizeof(*hdr))
-		return 0;
+	type &= IEEE80211_FCTL_FTYPE | IEEE80211_FCTL_STYPE;
 
-	skb_pull(skb, hdr_len);
-	type = le16_to_cpu(hdr->frame_control);
+	/* QoS data updates the link stats during its client lookup */
+	if (type != (IEEE80211_FTYPE_DATA | IEEE80211_STYPE_QOS_DATA))
+		xone_dongle_update_rx_stats(dongle, wcid, rssi);
 
-	switch (type & (IEEE80211_FCTL_FTYPE | IEEE80211_FCTL_STYPE)) {
+	switch (type) {
 	case IEEE80211_FTYPE_DATA | IEEE80211_STYPE_QOS_DATA:
-		return xone_dongle_handle_qos_data(dongle, skb, wcid);
+		return xone_dongle_handle_qos_data(dongle, skb, wcid, rssi);
 	case IEEE80211_FTYPE_MGMT | IEEE80211_STYPE_ASSOC_REQ:
 		return xone_dongle_handle_association(dongle, hdr->addr2);
 	case IEEE80211_FTYPE_MGMT | IEEE80211_STYPE_DISASSOC:
@@ -610,33 +1396,65 @@ static int xone_dongle_process_frame(struct xone_dongle *dongle,
 	return 0;
 }
 
+static void xone_dongle_account_rx_time(struct xone_dongle *dongle, s64 start)
+{
+	s64 time = ktime_get_ns() - start;
+	s64 max;
+
+	atomic_long_inc(&dongle->rx_frames);
+	atomic64_add(time, &dongle->rx_time_ns);
+
+	max = atomic64_read(&dongle->rx_max_ns);
+	while (time > max &&
+	       !atomic64_try_cmpxchg(&dongle->rx_max_ns, &max, time))
+		;
+}
+
 static int xone_dongle_process_wlan(struct xone_dongle *dongle,
 				    struct sk_buff *skb)
 {
 	struct mt76_rxwi *rxwi = (struct mt76_rxwi *)skb->data;
-	unsigned int hdr_len;
+	struct ieee80211_hdr_3addr *hdr;
+	unsigned int hdr_len, pad = 0;
+	s64 start = 0;
 	u32 ctl;
+	u8 wcid;
+
+	if (READ_ONCE(rx_timing))
+		start = ktime_get_ns();
 
 	if (skb->len < sizeof(*rxwi))
 		return -EINVAL;
 
 	skb_pull(skb, sizeof(*rxwi));
+	hdr = (struct ieee80211_hdr_3addr *)skb->data;
 	hdr_len = ieee80211_get_hdrlen_from_skb(skb);
 
-	/* 2 bytes of padding after 802.11 header */
+	/* 2 bytes of padding after 802.11 header, header is read in place */
 	if (rxwi->rxinfo & cpu_to_le32(MT_RXINFO_L2PAD)) {
 		if (skb->len < hdr_len + 2)
 			return -EINVAL;
 
-		memmove(skb->data + 2, skb->data, hdr_len);
-		skb_pull(skb, 2);
+		pad = 2;
+		atomic_long_inc(&dongle->rx_padded);
 	}
 
 	ctl = le32_to_cpu(rxwi->ctl);
-	skb_trim(skb, FIELD_GET(MT_RXWI_CTL_MPDU_LEN, ctl));
+	wcid = FIELD_GET(MT_RXWI_CTL_WCID, ctl);
+	skb_trim(skb, FIELD_GET(MT_RXWI_CTL_MPDU_LEN, ctl) + pad);
+
+	/* ignore invalid frames */
+	if (skb->len < hdr_len + pad || hdr_len < sizeof(*hdr))
+		return 0;
+
+	skb_pull(skb, hdr_len + pad);
 
-	return xone_dongle_process_frame(dongle, skb, hdr_len,
-					 FIELD_GET(MT_RXWI_CTL_WCID, ctl));
+	/* decode time of RXWI and 802.11 header */
+	if (start)
+		xone_dongle_account_rx_time(dongle, start);
+
+	return xone_dongle_process_frame(dongle, hdr, skb, wcid,
+					 rxwi->rssi[0]);
 }
 
 static int xone_dongle_process_message(struct xone_dongle *dongle,
@@ -644,6 +1462,7 @@ static int xone_dongle_process_message(struct xone_dongle *dongle,
 {
 	enum mt76_dma_msg_port port;
 	u32 info;
+	u8 seq;
 
 	/* command header + trailer */
 	if (skb->len < MT_CMD_HDR_LEN * 2)
@@ -653,7 +1472,8 @@ static int xone_dongle_process_message(struct xone_dongle *dongle,
 	port = FIELD_GET(MT_RX_FCE_INFO_D_PORT, info);
 
 	/* ignore command reponses */
-	if (FIELD_GET(MT_RX_FCE_INFO_CMD_SEQ, info) == 0x01)
+	seq = FIELD_GET(MT_RX_FCE_INFO_CMD_SEQ, info);
+	if (seq == 0x01)
 		return 0;
 
 	/* remove header + trailer */
@@ -667,12 +1487,18 @@ static int xone_dongle_process_message(struct xone_dongle *dongle,
 		return 0;
 
 	switch (FIELD_GET(MT_RX_FCE_INFO_EVT_TYPE, info)) {
+	case XONE_MT_EVT_CMD_DONE:
+		/* responses to asynchronous commands */
+		xone_mt76_complete_command(&dongle->mt, seq);
+		return 0;
 	case XONE_MT_EVT_BUTTON:
 		return xone_dongle_handle_button(dongle);
 	case XONE_MT_EVT_PACKET_RX:
 		return xone_dongle_process_wlan(dongle, skb);
 	case XONE_MT_EVT_CLIENT_LOST:
 		return xone_dongle_handle_loss(dongle, skb);
+	case XONE_MT_EVT_COREDUMP:
+		return xone_dongle_handle_coredump(dongle, skb);
 	}
 
 	return 0;
@@ -691,6 +1517,8 @@ static int xone_dongle_process_buffer(struct xone_dongle *dongle,
 	if (!skb)
 		return -ENOMEM;
 
+	/* RXWI carries no host time, use the URB completion time */
+	skb->tstamp = ktime_get();
 	skb_put_data(skb, data, len);
 
 	err = xone_dongle_process_message(dongle, skb);
@@ -706,9 +1534,27 @@ static int xone_dongle_process_buffer(struct xone_dongle *dongle,
 	return err;
 }
 
+static bool xone_dongle_retire_urb(struct xone_dongle_rx_pool *pool)
+{
+	unsigned long flags;
+	bool retire = false;
+
+	spin_lock_irqsave(&pool->lock, flags);
+
+	if (pool->count > pool->target) {
+		pool->count--;
+		retire = true;
+	}
+
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	return retire;
+}
+
 static void xone_dongle_complete_in(struct urb *urb)
 {
-	struct xone_dongle *dongle = urb->context;
+	struct xone_dongle_rx_pool *pool = urb->context;
+	struct xone_dongle *dongle = pool->dongle;
 	int err;
 
 	switch (urb->status) {
@@ -717,12 +1563,18 @@ static void xone_dongle_complete_in(struct urb *urb)
 	case -ENOENT:
 	case -ECONNRESET:
 	case -ESHUTDOWN:
-		usb_anchor_urb(urb, &dongle->urbs_in_idle);
+		usb_anchor_urb(urb, &pool->urbs_idle);
 		return;
+	case -EOVERFLOW:
+		pool->overflows++;
+		goto resubmit;
 	default:
 		goto resubmit;
 	}
 
+	atomic_inc(&pool->completions);
+	atomic_long_inc(&pool->progress);
+
 	err = xone_dongle_process_buffer(dongle, urb->transfer_buffer,
 					 urb->actual_length);
 	if (err)
@@ -730,14 +1582,20 @@ static void xone_dongle_complete_in(struct urb *urb)
 			__func__, err);
 
 resubmit:
+	/* buffers are freed by the tune work */
+	if (xone_dongle_retire_urb(pool)) {
+		usb_anchor_urb(urb, &pool->urbs_retired);
+		return;
+	}
+
 	/* can fail during USB device removal */
 	err = usb_submit_urb(urb, GFP_ATOMIC);
 	if (err) {
 		dev_dbg(dongle->mt.dev, "%s: submit failed: %d\n",
 			__func__, err);
-		usb_anchor_urb(urb, &dongle->urbs_in_idle);
+		usb_anchor_urb(urb, &pool->urbs_idle);
 	} else {
-		usb_anchor_urb(urb, &dongle->urbs_in_busy);
+		usb_anchor_urb(urb, &pool->urbs_busy);
 	}
 }
 
@@ -745,176 +1603,1359 @@ static void xone_dongle_complete_out(struct urb *urb)
 {
 	struct sk_buff *skb = urb->context;
 	struct xone_dongle_skb_cb *cb = (struct xone_dongle_skb_cb *)skb->cb;
+	struct xone_dongle_tx_pool *pool = cb->pool;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->lock, flags);
+
+	usb_anchor_urb(urb, &pool->urbs_idle);
+
+	if (!urb->status)
+		pool->completions++;
+
+	/* do not resubmit URBs that have been killed */
+	if (urb->status != -ENOENT && urb->status != -ECONNRESET &&
+	    urb->status != -ESHUTDOWN)
+		xone_dongle_tx_schedule(cb->dongle, pool);
+
+	spin_unlock_irqrestore(&pool->lock, flags);
 
-	usb_anchor_urb(urb, &cb->dongle->urbs_out_idle);
 	dev_consume_skb_any(skb);
 }
 
-static int xone_dongle_init_urbs_in(struct xone_dongle *dongle,
-				    int ep, int buf_len)
+static void xone_dongle_free_urb_in(struct urb *urb)
 {
-	struct xone_mt76 *mt = &dongle->mt;
+	usb_free_coherent(urb->dev, urb->transfer_buffer_length,
+			  urb->transfer_buffer, urb->transfer_dma);
+	usb_free_urb(urb);
+}
+
+static int xone_dongle_add_urb_in(struct xone_dongle_rx_pool *pool)
+{
+	struct xone_mt76 *mt = &pool->dongle->mt;
 	struct urb *urb;
 	void *buf;
-	int i, err;
+	unsigned long flags;
+	int err;
 
-	for (i = 0; i < XONE_DONGLE_NUM_IN_URBS; i++) {
-		urb = usb_alloc_urb(0, GFP_KERNEL);
-		if (!urb)
-			return -ENOMEM;
+	urb = usb_alloc_urb(0, GFP_KERNEL);
+	if (!urb)
+		return -ENOMEM;
 
-		usb_anchor_urb(urb, &dongle->urbs_in_busy);
+	buf = usb_alloc_coherent(mt->udev, pool->buf_len,
+				 GFP_KERNEL, &urb->transfer_dma);
+	if (!buf) {
 		usb_free_urb(urb);
+		return -ENOMEM;
+	}
 
-		buf = usb_alloc_coherent(mt->udev, buf_len,
-					 GFP_KERNEL, &urb->transfer_dma);
-		if (!buf)
-			return -ENOMEM;
+	usb_fill_bulk_urb(urb, mt->udev,
+			  usb_rcvbulkpipe(mt->udev, pool->ep), buf,
+			  pool->buf_len, xone_dongle_complete_in, pool);
+	urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
 
-		usb_fill_bulk_urb(urb, mt->udev,
-				  usb_rcvbulkpipe(mt->udev, ep), buf, buf_len,
-				  xone_dongle_complete_in, dongle);
-		urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+	spin_lock_irqsave(&pool->lock, flags);
+	pool->count++;
+	spin_unlock_irqrestore(&pool->lock, flags);
 
-		err = usb_submit_urb(urb, GFP_KERNEL);
-		if (err)
-			return err;
+	usb_anchor_urb(urb, &pool->urbs_busy);
+
+	err = usb_submit_urb(urb, GFP_KERNEL);
+	if (err) {
+		usb_unanchor_urb(urb);
+		usb_anchor_urb(urb, &pool->urbs_idle);
 	}
 
-	return 0;
+	usb_free_urb(urb);
+
+	return err;
 }
 
-static int xone_dongle_init_urbs_out(struct xone_dongle *dongle)
+static void xone_dongle_init_rx_pool(struct xone_dongle *dongle,
+				     struct xone_dongle_rx_pool *pool,
+				     int ep, int buf_len)
 {
-	struct xone_mt76 *mt = &dongle->mt;
-	struct urb *urb;
-	int i;
+	pool->dongle = dongle;
+	pool->ep = ep;
+	pool->buf_len = buf_len;
+	pool->target = max(rx_urbs_min, 1u);
+	spin_lock_init(&pool->lock);
+	init_usb_anchor(&pool->urbs_idle);
+	init_usb_anchor(&pool->urbs_busy);
+	init_usb_anchor(&pool->urbs_retired);
+}
 
-	for (i = 0; i < XONE_DONGLE_NUM_OUT_URBS; i++) {
-		urb = usb_alloc_urb(0, GFP_KERNEL);
-		if (!urb)
-			return -ENOMEM;
+static int xone_dongle_init_urbs_in(struct xone_dongle_rx_pool *pool)
+{
+	int i, err;
 
-		usb_fill_bulk_urb(urb, mt->udev,
-				  usb_sndbulkpipe(mt->udev, XONE_MT_EP_OUT),
-				  NULL, 0, xone_dongle_complete_out, NULL);
-		usb_anchor_urb(urb, &dongle->urbs_out_idle);
-		usb_free_urb(urb);
+	for (i = 0; i < pool->target; i++) {
+		err = xone_dongle_add_urb_in(pool);
+		if (err)
+			return err;
 	}
 
 	return 0;
 }
 
-static int xone_dongle_init(struct xone_dongle *dongle)
+static void xone_dongle_tune_urbs_in(struct xone_dongle *dongle,
+				     struct xone_dongle_rx_pool *pool)
 {
-	struct xone_mt76 *mt = &dongle->mt;
+	unsigned int urbs_min = max(rx_urbs_min, 1u);
+	unsigned int urbs_max = max(rx_urbs_max, urbs_min);
+	unsigned int target, count;
+	struct urb *urb;
+	unsigned long flags;
 	int err;
 
-	init_usb_anchor(&dongle->urbs_out_idle);
-	init_usb_anchor(&dongle->urbs_out_busy);
-	init_usb_anchor(&dongle->urbs_in_idle);
-	init_usb_anchor(&dongle->urbs_in_busy);
-
-	err = xone_dongle_init_urbs_out(dongle);
-	if (err)
-		return err;
-
-	err = xone_dongle_init_urbs_in(dongle, XONE_MT_EP_IN_CMD,
-				       XONE_DONGLE_LEN_CMD_PKT);
-	if (err)
-		return err;
+	/* completion rate over the last tuning interval */
+	pool->rate = atomic_xchg(&pool->completions, 0) * HZ /
+		     XONE_DONGLE_RX_TUNE_INTERVAL;
+
+	target = urbs_min + atomic_read(&dongle->client_count) *
+			    XONE_DONGLE_RX_URBS_PER_CLIENT +
+		 pool->rate / XONE_DONGLE_RX_RATE_PER_URB;
+	target = clamp(target, urbs_min, urbs_max);
+
+	/* surplus URBs get retired on completion */
+	spin_lock_irqsave(&pool->lock, flags);
+	pool->target = target;
+	count = pool->count;
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	for (; count < target; count++) {
+		err = xone_dongle_add_urb_in(pool);
+		if (err) {
+			dev_dbg(dongle->mt.dev, "%s: add URB failed: %d\n",
+				__func__, err);
+			break;
+		}
+	}
 
-	err = xone_dongle_init_urbs_in(dongle, XONE_MT_EP_IN_WLAN,
-				       XONE_DONGLE_LEN_WLAN_PKT);
-	if (err)
-		return err;
+	while ((urb = usb_get_from_anchor(&pool->urbs_retired)))
+		xone_dongle_free_urb_in(urb);
+}
 
-	err = xone_mt76_load_firmware(mt, "xow_dongle.bin");
-	if (err) {
-		dev_err(mt->dev, "%s: load firmware failed: %d\n",
-			__func__, err);
-		return err;
-	}
+static void xone_dongle_rx_tune(struct work_struct *work)
+{
+	struct xone_dongle *dongle = container_of(to_delayed_work(work),
+						  typeof(*dongle),
+						  rx_tune_work);
 
-	err = xone_mt76_init_radio(mt);
-	if (err)
-		dev_err(mt->dev, "%s: init radio failed: %d\n", __func__, err);
+	xone_dongle_tune_urbs_in(dongle, &dongle->rx_cmd);
+	xone_dongle_tune_urbs_in(dongle, &dongle->rx_wlan);
 
-	return err;
+	schedule_delayed_work(&dongle->rx_tune_work,
+			      XONE_DONGLE_RX_TUNE_INTERVAL);
 }
 
-static int xone_dongle_power_off_clients(struct xone_dongle *dongle)
+static void xone_dongle_update_tx_stats(struct xone_dongle *dongle,
+					const struct xone_mt76_tx_status *stat)
 {
 	struct xone_dongle_client *client;
-	int i;
-	int err = 0;
 	unsigned long flags;
 
-	spin_lock_irqsave(&dongle->clients_lock, flags);
+	/* TXWI WCIDs start at zero */
+	if (stat->wcid >= XONE_DONGLE_MAX_CLIENTS)
+		return;
 
-	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
-		client = dongle->clients[i];
-		if (!client)
-			continue;
+	spin_lock_irqsave(&dongle->clients_lock, flags);
 
-		err = gip_power_off_adapter(client->adapter);
-		if (err)
-			break;
+	client = dongle->clients[stat->wcid];
+	if (client) {
+		client->link.tx_frames++;
+		client->link.tx_retries += stat->retries;
+		client->rate.frames++;
+		client->rate.retries += stat->retries;
+
+		if (!stat->success) {
+			client->link.tx_failed++;
+			client->rate.failed++;
+		}
 	}
 
 	spin_unlock_irqrestore(&dongle->clients_lock, flags);
+}
 
-	if (err)
-		return err;
+static bool xone_dongle_adapt_rate(struct xone_dongle_rate_ctrl *rate)
+{
+	if (rate->frames < XONE_DONGLE_RATE_MIN_FRAMES)
+		return rate->good;
 
-	/* can time out if new client connects */
-	if (!wait_event_timeout(dongle->disconnect_wait,
-				!atomic_read(&dongle->client_count),
-				XONE_DONGLE_PWR_OFF_TIMEOUT))
-		return -ETIMEDOUT;
+	rate->last_per = rate->failed * 100 / rate->frames;
+	rate->last_retries = rate->retries * 10 / rate->frames;
 
-	return xone_dongle_toggle_pairing(dongle, false);
+	/* more than 5% lost or one retry per frame: fall back */
+	/* no losses and less than one retry per 10 frames: step up */
+	if (rate->last_per >= 5 || rate->last_retries >= 10) {
+		if (rate->index)
+			WRITE_ONCE(rate->index, rate->index - 1);
+
+		rate->good = false;
+	} else if (!rate->failed && !rate->last_retries) {
+		if (rate->index < XONE_DONGLE_RATE_MAX_INDEX)
+			WRITE_ONCE(rate->index, rate->index + 1);
+
+		rate->good = true;
+	}
+
+	rate->frames = 0;
+	rate->failed = 0;
+	rate->retries = 0;
+
+	return rate->good;
 }
 
-static void xone_dongle_destroy(struct xone_dongle *dongle)
+static void xone_dongle_adapt_rates(struct xone_dongle *dongle)
 {
 	struct xone_dongle_client *client;
-	struct urb *urb;
+	bool good = true;
+	unsigned long flags;
 	int i;
 
-	usb_kill_anchored_urbs(&dongle->urbs_in_busy);
-	destroy_workqueue(dongle->event_wq);
-	cancel_delayed_work_sync(&dongle->pairing_work);
+	if (!READ_ONCE(tx_adaptation)) {
+		xone_mt76_set_retry_limits(&dongle->mt, XONE_MT_RETRY_SHORT,
+					   XONE_MT_RETRY_LONG);
+		return;
+	}
+
+	spin_lock_irqsave(&dongle->clients_lock, flags);
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		client = dongle->clients[i];
+		if (client && client->adapter)
+			good &= xone_dongle_adapt_rate(&client->rate);
+	}
+
+	spin_unlock_irqrestore(&dongle->clients_lock, flags);
+
+	/* retry limits are shared, only lower them if all links are good */
+	if (good)
+		xone_mt76_set_retry_limits(&dongle->mt,
+					   XONE_DONGLE_RETRY_SHORT_GOOD,
+					   XONE_DONGLE_RETRY_LONG_GOOD);
+	else
+		xone_mt76_set_retry_limits(&dongle->mt, XONE_MT_RETRY_SHORT,
+					   XONE_MT_RETRY_LONG);
+}
+
+static void xone_dongle_request_stats(struct xone_dongle *dongle)
+{
+	struct xone_dongle_client *client;
+	u8 addrs[XONE_DONGLE_MAX_CLIENTS][ETH_ALEN];
+	DECLARE_BITMAP(wcids, XONE_DONGLE_MAX_CLIENTS) = {};
+	unsigned long flags;
+	int i, err;
+
+	spin_lock_irqsave(&dongle->clients_lock, flags);
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		client = dongle->clients[i];
+		if (!client || !client->adapter)
+			continue;
+
+		memcpy(addrs[i], client->address, ETH_ALEN);
+		set_bit(i, wcids);
+	}
+
+	spin_unlock_irqrestore(&dongle->clients_lock, flags);
+
+	for_each_set_bit(i, wcids, XONE_DONGLE_MAX_CLIENTS) {
+		err = xone_mt76_send_client_command(&dongle->mt, i + 1,
+						    addrs[i],
+						    XONE_MT_CLIENT_STATISTICS_REQ,
+						    NULL, 0);
+		if (err)
+			dev_dbg(dongle->mt.dev, "%s: request failed: %d\n",
+				__func__, err);
+	}
+}
+
+static void xone_dongle_collect_stats(struct work_struct *work)
+{
+	struct xone_dongle *dongle = container_of(to_delayed_work(work),
+						  typeof(*dongle),
+						  stats_work);
+	struct xone_mt76_tx_status stat;
+	int i;
+
+	if (!atomic_read(&dongle->client_count))
+		goto err_schedule;
+
+	for (i = 0; i < XONE_DONGLE_TX_STATUS_BUDGET; i++) {
+		if (!xone_mt76_read_tx_status(&dongle->mt, &stat))
+			break;
+
+		xone_dongle_update_tx_stats(dongle, &stat);
+	}
+
+	xone_dongle_adapt_rates(dongle);
+
+	/* pick up changes of the idle policy */
+	if (dongle->pm_hold != xone_dongle_want_hold(dongle))
+		schedule_work(&dongle->pm_work);
+
+	if (READ_ONCE(client_stats) &&
+	    !(++dongle->stats_runs % XONE_DONGLE_STATS_REQ_INTERVAL))
+		xone_dongle_request_stats(dongle);
+
+err_schedule:
+	schedule_delayed_work(&dongle->stats_work, XONE_DONGLE_STATS_INTERVAL);
+}
+
+/* snapshot, channel selection runs without xone_dongle_list_lock */
+static void xone_dongle_update_penalties(struct xone_dongle *dongle)
+{
+	struct xone_mt76 *mt = &dongle->mt;
+	struct xone_dongle *other;
+	int i, dist;
+
+	memset(mt->penalty, 0, sizeof(mt->penalty));
+
+	mutex_lock(&xone_dongle_list_lock);
+
+	list_for_each_entry(other, &xone_dongle_list, node) {
+		if (other == dongle || !other->channel)
+			continue;
+
+		/* adjacent 5 GHz channels share wide channels */
+		for (i = 0; i < XONE_MT_NUM_CHANNELS; i++) {
+			dist = abs(xone_mt76_channel_index(i) -
+				   other->channel->index);
+			if (!dist)
+				mt->penalty[i] += XONE_DONGLE_CHANNEL_PENALTY;
+			else if (dist < 5)
+				mt->penalty[i] += XONE_DONGLE_OVERLAP_PENALTY;
+		}
+	}
+
+	mutex_unlock(&xone_dongle_list_lock);
+}
+
+static void xone_dongle_publish_channel(struct xone_dongle *dongle)
+{
+	mutex_lock(&xone_dongle_list_lock);
+	dongle->channel = dongle->mt.channel;
+	mutex_unlock(&xone_dongle_list_lock);
+}
+
+static int xone_dongle_migrate_clients(struct xone_dongle *dongle, int score)
+{
+	struct xone_mt76 *mt = &dongle->mt;
+	struct xone_mt76_channel *chan = xone_mt76_best_channel(mt);
+	struct xone_dongle_client *client;
+	u8 addrs[XONE_DONGLE_MAX_CLIENTS][ETH_ALEN];
+	DECLARE_BITMAP(wcids, XONE_DONGLE_MAX_CLIENTS) = {};
+	unsigned long flags;
+	int i, err;
+
+	/* scores of other channels date from the last full evaluation */
+	if (chan == mt->channel ||
+	    mt->survey[chan - mt->channels].score +
+	    mt->penalty[chan - mt->channels] +
+	    XONE_DONGLE_SURVEY_MARGIN > score)
+		return 0;
+
+	spin_lock_irqsave(&dongle->clients_lock, flags);
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		client = dongle->clients[i];
+		if (!client || !client->adapter)
+			continue;
+
+		memcpy(addrs[i], client->address, ETH_ALEN);
+		set_bit(i, wcids);
+	}
+
+	spin_unlock_irqrestore(&dongle->clients_lock, flags);
+
+	dev_dbg(mt->dev, "%s: channel=%u, score=%d\n", __func__,
+		chan->index, score);
+
+	for_each_set_bit(i, wcids, XONE_DONGLE_MAX_CLIENTS) {
+		err = xone_mt76_send_client_command(mt, i + 1, addrs[i],
+						    XONE_MT_CLIENT_CHANGE_CHAN_REQ,
+						    &chan->index,
+						    sizeof(chan->index));
+		if (err)
+			dev_err(mt->dev, "%s: change channel failed: %d\n",
+				__func__, err);
+	}
+
+	return xone_mt76_change_channel(mt, chan);
+}
+
+static void xone_dongle_survey(struct work_struct *work)
+{
+	struct xone_dongle *dongle = container_of(to_delayed_work(work),
+						  typeof(*dongle),
+						  survey_work);
+	unsigned int interval = READ_ONCE(survey_interval);
+	int score, err = 0;
+
+	if (!interval) {
+		schedule_delayed_work(&dongle->survey_work,
+				      XONE_DONGLE_SURVEY_IDLE);
+		return;
+	}
+
+	score = xone_mt76_survey_channel(&dongle->mt);
+	if (score < XONE_DONGLE_SURVEY_THRESHOLD)
+		goto err_schedule;
+
+	mutex_lock(&dongle->pairing_lock);
+
+	/* pairing clients expect the current channel */
+	if (dongle->pairing)
+		goto err_unlock;
+
+	xone_dongle_update_penalties(dongle);
+
+	/* full evaluation leaves the channel, only possible without clients */
+	if (!atomic_read(&dongle->client_count))
+		err = xone_mt76_reselect_channel(&dongle->mt,
+						 XONE_DONGLE_SURVEY_MARGIN);
+	else if (READ_ONCE(channel_migration))
+		err = xone_dongle_migrate_clients(dongle, score);
+
+	xone_dongle_publish_channel(dongle);
+
+err_unlock:
+	mutex_unlock(&dongle->pairing_lock);
+
+	if (err)
+		dev_err(dongle->mt.dev, "%s: reselect channel failed: %d\n",
+			__func__, err);
+
+err_schedule:
+	schedule_delayed_work(&dongle->survey_work, interval * HZ);
+}
+
+static int xone_dongle_resume_urbs_in(struct xone_dongle_rx_pool *pool)
+{
+	struct urb *urb;
+	int err;
+
+	while ((urb = usb_get_from_anchor(&pool->urbs_idle))) {
+		usb_anchor_urb(urb, &pool->urbs_busy);
+		usb_free_urb(urb);
+
+		err = usb_submit_urb(urb, GFP_KERNEL);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static void xone_dongle_free_urbs_in(struct xone_dongle_rx_pool *pool)
+{
+	struct urb *urb;
+
+	usb_kill_anchored_urbs(&pool->urbs_busy);
+
+	while ((urb = usb_get_from_anchor(&pool->urbs_idle)))
+		xone_dongle_free_urb_in(urb);
+
+	while ((urb = usb_get_from_anchor(&pool->urbs_retired)))
+		xone_dongle_free_urb_in(urb);
+}
+
+static void xone_dongle_init_tx_pool(struct xone_dongle_tx_pool *pool,
+				     enum xone_dongle_queue queue)
+{
+	int i;
+
+	pool->queue = queue;
+	spin_lock_init(&pool->lock);
+	init_usb_anchor(&pool->urbs_idle);
+	init_usb_anchor(&pool->urbs_busy);
+	INIT_LIST_HEAD(&pool->active);
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		__skb_queue_head_init(&pool->queues[i].skbs);
+		INIT_LIST_HEAD(&pool->queues[i].node);
+	}
+}
+
+static int xone_dongle_init_urbs_out(struct xone_dongle *dongle,
+				     struct xone_dongle_tx_pool *pool,
+				     int num_urbs)
+{
+	struct xone_mt76 *mt = &dongle->mt;
+	struct urb *urb;
+	int i;
+
+	/* firmware only accepts packets on the command endpoint */
+	for (i = 0; i < num_urbs; i++) {
+		urb = usb_alloc_urb(0, GFP_KERNEL);
+		if (!urb)
+			return -ENOMEM;
+
+		usb_fill_bulk_urb(urb, mt->udev,
+				  usb_sndbulkpipe(mt->udev, XONE_MT_EP_OUT),
+				  NULL, 0, xone_dongle_complete_out, NULL);
+		usb_anchor_urb(urb, &pool->urbs_idle);
+		usb_free_urb(urb);
+	}
+
+	return 0;
+}
+
+static void xone_dongle_free_tx_pool(struct xone_dongle_tx_pool *pool)
+{
+	struct urb *urb;
+	int i;
+
+	usb_kill_anchored_urbs(&pool->urbs_busy);
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++)
+		xone_dongle_reset_tx_queue(pool, i + 1);
+
+	while ((urb = usb_get_from_anchor(&pool->urbs_idle)))
+		usb_free_urb(urb);
+}
+
+static int xone_dongle_init(struct xone_dongle *dongle)
+{
+	struct xone_mt76 *mt = &dongle->mt;
+	int err;
+
+	err = xone_dongle_init_urbs_out(dongle, &dongle->tx_data,
+					XONE_DONGLE_NUM_DATA_URBS);
+	if (err)
+		return err;
+
+	err = xone_dongle_init_urbs_out(dongle, &dongle->tx_audio,
+					XONE_DONGLE_NUM_AUDIO_URBS);
+	if (err)
+		return err;
+
+	err = xone_dongle_init_urbs_in(&dongle->rx_cmd);
+	if (err)
+		return err;
+
+	err = xone_dongle_init_urbs_in(&dongle->rx_wlan);
+	if (err)
+		return err;
+
+	err = xone_mt76_load_firmware(mt, "xow_dongle.bin");
+	if (err) {
+		dev_err(mt->dev, "%s: load firmware failed: %d\n",
+			__func__, err);
+		return err;
+	}
+
+	/* avoid channels selected by other dongles */
+	xone_dongle_update_penalties(dongle);
+	err = xone_mt76_init_radio(mt);
+	if (err) {
+		dev_err(mt->dev, "%s: init radio failed: %d\n", __func__, err);
+		return err;
+	}
+
+	xone_dongle_publish_channel(dongle);
+
+	return 0;
+}
+
+static int xone_dongle_restore(struct xone_dongle *dongle)
+{
+	struct xone_mt76 *mt = &dongle->mt;
+	int err;
+
+	/* device lost its state, reuse calibration of first init */
+	err = xone_mt76_load_firmware(mt, "xow_dongle.bin");
+	if (err) {
+		dev_err(mt->dev, "%s: load firmware failed: %d\n",
+			__func__, err);
+		return err;
+	}
+
+	err = xone_mt76_restore_radio(mt);
+	if (err)
+		dev_err(mt->dev, "%s: restore radio failed: %d\n",
+			__func__, err);
+
+	return err;
+}
+
+static int xone_dongle_restore_clients(struct xone_dongle *dongle)
+{
+	struct xone_mt76 *mt = &dongle->mt;
+	struct xone_dongle_client *client;
+	int i, err;
+
+	/* runs on event_wq, clients cannot be added or removed */
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		client = dongle->clients[i];
+		if (!client || !client->adapter)
+			continue;
+
+		err = xone_mt76_restore_client(mt, client->wcid,
+					       client->address);
+		if (err)
+			return err;
+
+		if (client->key_valid) {
+			err = xone_mt76_set_client_key(mt, client->wcid,
+						       client->key,
+						       sizeof(client->key));
+			if (err)
+				return err;
+		}
+	}
+
+	if (atomic_read(&dongle->client_count) && !dongle->pairing)
+		return xone_mt76_set_led_mode(mt, XONE_MT_LED_ON);
+
+	return 0;
+}
+
+/* pairing and clients after the firmware or radio lost its state */
+static int xone_dongle_restore_state(struct xone_dongle *dongle)
+{
+	int err;
+
+	lockdep_assert_held(&dongle->pairing_lock);
+
+	if (dongle->pairing) {
+		err = xone_mt76_set_pairing(&dongle->mt, true);
+		if (err)
+			return err;
+	}
+
+	return xone_dongle_restore_clients(dongle);
+}
+
+static void xone_dongle_restore_work(struct work_struct *work)
+{
+	struct xone_dongle *dongle = container_of(work, typeof(*dongle),
+						  restore_work);
+	int err;
+
+	/* wait for pending associations */
+	flush_workqueue(dongle->assoc_wq);
+
+	mutex_lock(&dongle->pairing_lock);
+	err = xone_dongle_restore_state(dongle);
+	mutex_unlock(&dongle->pairing_lock);
+
+	/* plugged by xone_dongle_queue_restore */
+	xone_dongle_plug_tx(dongle, &dongle->tx_data, false);
+	xone_dongle_plug_tx(dongle, &dongle->tx_audio, false);
+
+	if (err)
+		dev_err(dongle->mt.dev, "%s: restore clients failed: %d\n",
+			__func__, err);
+}
+
+/* resume cannot touch the clients, event processing owns them */
+static void xone_dongle_queue_restore(struct xone_dongle *dongle)
+{
+	/* hold back GIP frames until the clients are back */
+	xone_dongle_plug_tx(dongle, &dongle->tx_data, true);
+	xone_dongle_plug_tx(dongle, &dongle->tx_audio, true);
+
+	if (!queue_work(dongle->event_wq, &dongle->restore_work)) {
+		xone_dongle_plug_tx(dongle, &dongle->tx_data, false);
+		xone_dongle_plug_tx(dongle, &dongle->tx_audio, false);
+	}
+}
+
+static int xone_dongle_recover(struct xone_dongle *dongle, bool reload)
+{
+	ktime_t start = ktime_get();
+	int err;
+
+	/* wait for pending associations */
+	flush_workqueue(dongle->assoc_wq);
+
+	/* keep survey and pairing away from the radio */
+	mutex_lock(&dongle->pairing_lock);
+
+	/* hold back GIP frames until the radio is back */
+	xone_dongle_plug_tx(dongle, &dongle->tx_data, true);
+	xone_dongle_plug_tx(dongle, &dongle->tx_audio, true);
+
+	if (reload)
+		err = xone_dongle_restore(dongle);
+	else
+		err = xone_mt76_restore_radio(&dongle->mt);
+
+	if (!err)
+		err = xone_dongle_restore_state(dongle);
+
+	xone_dongle_plug_tx(dongle, &dongle->tx_data, false);
+	xone_dongle_plug_tx(dongle, &dongle->tx_audio, false);
+	mutex_unlock(&dongle->pairing_lock);
+
+	if (err) {
+		dongle->recovery_failures++;
+		return err;
+	}
+
+	dongle->recoveries++;
+	dongle->recovery_ms = ktime_ms_delta(ktime_get(), start);
+
+	dev_info(dongle->mt.dev, "%s: recovered in %lldms\n", __func__,
+		 dongle->recovery_ms);
+
+	return 0;
+}
+
+static void xone_dongle_coredump(struct work_struct *work)
+{
+	struct xone_dongle *dongle = container_of(to_delayed_work(work),
+						  typeof(*dongle),
+						  coredump_work);
+	struct sk_buff_head skbs;
+	struct sk_buff *skb;
+	size_t len = 0;
+	u8 *buf;
+	int err;
+
+	__skb_queue_head_init(&skbs);
+	skb_queue_splice_init(&dongle->coredump_skbs, &skbs);
+
+	skb_queue_walk(&skbs, skb)
+		len += skb->len;
+
+	dev_err(dongle->mt.dev, "%s: firmware crashed, dump size: %zu\n",
+		__func__, len);
+
+	/* freed by devcoredump */
+	buf = vmalloc(len);
+	if (buf) {
+		len = 0;
+		while ((skb = __skb_dequeue(&skbs))) {
+			memcpy(buf + len, skb->data, skb->len);
+			len += skb->len;
+			kfree_skb(skb);
+		}
+
+		dev_coredumpv(dongle->mt.dev, buf, len, GFP_KERNEL);
+	}
+
+	__skb_queue_purge(&skbs);
+	dongle->coredumps++;
+
+	err = xone_dongle_recover(dongle, true);
+	if (err)
+		dev_err(dongle->mt.dev, "%s: recovery failed: %d\n",
+			__func__, err);
+}
+
+static int xone_dongle_restart_urbs_in(struct xone_dongle_rx_pool *pool)
+{
+	/* killed URBs get moved to the idle anchor */
+	usb_kill_anchored_urbs(&pool->urbs_busy);
+
+	return xone_dongle_resume_urbs_in(pool);
+}
+
+static int xone_dongle_escalate(struct xone_dongle *dongle)
+{
+	struct usb_interface *intf = to_usb_interface(dongle->mt.dev);
+	enum xone_dongle_recovery step = dongle->watchdog_step;
+	int err;
+
+	dev_warn(dongle->mt.dev, "%s: stalled, step=%d\n", __func__, step);
+	dongle->watchdog_counts[step]++;
+
+	if (step < XONE_DONGLE_RECOVER_USB)
+		dongle->watchdog_step++;
+
+	switch (step) {
+	case XONE_DONGLE_RECOVER_URBS:
+		err = xone_dongle_restart_urbs_in(&dongle->rx_cmd);
+		if (err)
+			return err;
+
+		return xone_dongle_restart_urbs_in(&dongle->rx_wlan);
+	case XONE_DONGLE_RECOVER_RADIO:
+		return xone_dongle_recover(dongle, false);
+	case XONE_DONGLE_RECOVER_FIRMWARE:
+		return xone_dongle_recover(dongle, true);
+	default:
+		/* rebinds the driver, see xone_dongle_pre_reset */
+		usb_queue_reset_device(intf);
+		return 0;
+	}
+}
+
+static void xone_dongle_watchdog(struct work_struct *work)
+{
+	struct xone_dongle *dongle = container_of(to_delayed_work(work),
+						  typeof(*dongle),
+						  watchdog_work);
+	long progress = atomic_long_read(&dongle->rx_wlan.progress) +
+			atomic_long_read(&dongle->rx_cmd.progress);
+	unsigned long tx = READ_ONCE(dongle->tx_data.completions) +
+			   READ_ONCE(dongle->tx_audio.completions);
+	unsigned int timeouts = dongle->mt.cmd_timeouts;
+	bool silent, stalled;
+	int err;
+
+	/* idle clients might not send anything */
+	silent = progress == dongle->watchdog_progress &&
+		 atomic_read(&dongle->client_count);
+	stalled = silent;
+
+	/* unanswered MCU commands or TX without any RX */
+	if ((timeouts != dongle->watchdog_timeouts &&
+	     !READ_ONCE(dongle->mt.cmd_no_response)) ||
+	    (silent && tx != dongle->watchdog_tx)) {
+		dongle->watchdog_hard = true;
+		stalled = true;
+	}
+
+	dongle->watchdog_progress = progress;
+	dongle->watchdog_tx = tx;
+	dongle->watchdog_timeouts = timeouts;
+
+	if (!stalled || !READ_ONCE(watchdog)) {
+		dongle->watchdog_stalls = 0;
+		dongle->watchdog_hard = false;
+		dongle->watchdog_step = XONE_DONGLE_RECOVER_URBS;
+	} else if (++dongle->watchdog_stalls >= XONE_DONGLE_WATCHDOG_STALLS) {
+		dongle->watchdog_stalls = 0;
+
+		/* silence alone only restarts the URBs once */
+		if (dongle->watchdog_step == XONE_DONGLE_RECOVER_URBS ||
+		    dongle->watchdog_hard) {
+			err = xone_dongle_escalate(dongle);
+			if (err)
+				dev_err(dongle->mt.dev,
+					"%s: recovery failed: %d\n",
+					__func__, err);
+		}
+
+		dongle->watchdog_hard = false;
+	}
+
+	queue_delayed_work(dongle->event_wq, &dongle->watchdog_work,
+			   XONE_DONGLE_WATCHDOG_INTERVAL);
+}
+
+static int xone_dongle_power_off_clients(struct xone_dongle *dongle)
+{
+	struct xone_dongle_client *client;
+	ktime_t start = ktime_get();
+	int i, ret;
+	int err = 0;
+	unsigned long flags;
+
+	/* new clients would never receive the power off */
+	WRITE_ONCE(dongle->draining, true);
+
+	/* wait for pending associations */
+	flush_workqueue(dongle->event_wq);
+	flush_workqueue(dongle->assoc_wq);
+
+	/* submit all power off packets at once */
+	xone_dongle_plug_tx(dongle, &dongle->tx_data, true);
+	spin_lock_irqsave(&dongle->clients_lock, flags);
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		client = dongle->clients[i];
+		if (!client || !client->adapter)
+			continue;
+
+		ret = gip_power_off_adapter(client->adapter);
+		if (ret)
+			err = ret;
+		else
+			set_bit(i, &dongle->pwr_off_pending);
+	}
+
+	spin_unlock_irqrestore(&dongle->clients_lock, flags);
+	xone_dongle_plug_tx(dongle, &dongle->tx_data, false);
+
+	/* each client gets removed once it has disassociated */
+	if (!wait_event_timeout(dongle->disconnect_wait,
+				!READ_ONCE(dongle->pwr_off_pending),
+				XONE_DONGLE_PWR_OFF_TIMEOUT)) {
+		dongle->pwr_off_timeouts++;
+		err = -ETIMEDOUT;
+	}
+
+	dongle->pwr_off_pending = 0;
+	dongle->pwr_off_ms = ktime_ms_delta(ktime_get(), start);
+	dev_dbg(dongle->mt.dev, "%s: time=%lldms\n", __func__,
+		dongle->pwr_off_ms);
+
+	if (!err)
+		err = xone_dongle_toggle_pairing(dongle, false);
+
+	WRITE_ONCE(dongle->draining, false);
+
+	return err;
+}
+
+static void xone_dongle_show_tx_pool(struct seq_file *s,
+				     struct xone_dongle_tx_pool *pool,
+				     const char *name)
+{
+	struct xone_dongle_tx_queue *txq;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&pool->lock, flags);
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		txq = &pool->queues[i];
+		seq_printf(s, "%s %d %u %u %d %lu %lu %lu\n", name, i + 1,
+			   skb_queue_len(&txq->skbs), txq->max_depth,
+			   txq->deficit, txq->packets, txq->bytes, txq->drops);
+	}
+
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+static int xone_dongle_debugfs_tx_queues(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+
+	seq_puts(s, "pool wcid depth max_depth deficit packets bytes drops\n");
+	xone_dongle_show_tx_pool(s, &dongle->tx_data, "data");
+	xone_dongle_show_tx_pool(s, &dongle->tx_audio, "audio");
+
+	return 0;
+}
+
+static void xone_dongle_show_rx_pool(struct seq_file *s,
+				     struct xone_dongle_rx_pool *pool,
+				     const char *name, size_t *total)
+{
+	unsigned int count, target;
+	unsigned long flags;
+	size_t bytes;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	count = pool->count;
+	target = pool->target;
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	bytes = (size_t)count * pool->buf_len;
+	*total += bytes;
+
+	seq_printf(s, "%s 0x%02x %d %u %u %u %lu %zu\n", name, pool->ep,
+		   pool->buf_len, count, target, pool->rate, pool->overflows,
+		   bytes);
+}
+
+static int xone_dongle_debugfs_rx_memory(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+	size_t total = 0;
+
+	seq_puts(s, "pool ep buf_len urbs target rate overflows bytes\n");
+	xone_dongle_show_rx_pool(s, &dongle->rx_cmd, "cmd", &total);
+	xone_dongle_show_rx_pool(s, &dongle->rx_wlan, "wlan", &total);
+	seq_printf(s, "total %zu\n", total);
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_rx_timing(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+	long frames = atomic_long_read(&dongle->rx_frames);
+	s64 time = atomic64_read(&dongle->rx_time_ns);
+
+	seq_printf(s, "frames %ld\n", frames);
+	seq_printf(s, "padded %ld\n", atomic_long_read(&dongle->rx_padded));
+	seq_printf(s, "avg_ns %lld\n", frames ? div_s64(time, frames) : 0);
+	seq_printf(s, "max_ns %lld\n", atomic64_read(&dongle->rx_max_ns));
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_events(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+
+	seq_printf(s, "size %d\n", XONE_DONGLE_NUM_EVENTS);
+	seq_printf(s, "pending %u\n", atomic_read(&dongle->events_head) -
+				      READ_ONCE(dongle->events_tail));
+	seq_printf(s, "high_water %d\n",
+		   atomic_read(&dongle->events_high_water));
+	seq_printf(s, "produced %ld\n",
+		   atomic_long_read(&dongle->events_produced));
+	seq_printf(s, "overflows %ld\n",
+		   atomic_long_read(&dongle->events_overflows));
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_association(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+	struct xone_dongle_assoc_stats stats;
+	unsigned long flags;
+	int i;
+
+	seq_puts(s, "wcid address queue_us adapter_us associate_us led_us total_us err\n");
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		spin_lock_irqsave(&dongle->clients_lock, flags);
+		stats = dongle->assoc_stats[i];
+		spin_unlock_irqrestore(&dongle->clients_lock, flags);
+
+		if (is_zero_ether_addr(stats.address))
+			continue;
+
+		seq_printf(s, "%d %pM %lld %lld %lld %lld %lld %d\n", i + 1,
+			   stats.address, stats.queue_us, stats.adapter_us,
+			   stats.associate_us, stats.led_us, stats.total_us,
+			   stats.err);
+	}
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_firmware(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+
+	seq_printf(s, "ilm_us %lld\n", dongle->mt.fw_ilm_us);
+	seq_printf(s, "dlm_us %lld\n", dongle->mt.fw_dlm_us);
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_registers(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+	struct xone_mt76 *mt = &dongle->mt;
+
+	seq_printf(s, "batched_writes %u\n", mt->reg_writes);
+	seq_printf(s, "commands %u\n", mt->reg_commands);
+	seq_printf(s, "round_trips_saved %u\n",
+		   mt->reg_writes - mt->reg_commands);
+	seq_printf(s, "init_registers_us %lld\n", mt->init_regs_us);
+	seq_printf(s, "async_commands %u\n", mt->cmd_async);
+	seq_printf(s, "responses %d\n", atomic_read(&mt->cmd_responses));
+	seq_printf(s, "timeouts %u\n", mt->cmd_timeouts);
+	seq_printf(s, "confirmed %d\n", !READ_ONCE(mt->cmd_no_response));
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_efuse(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+	struct xone_mt76 *mt = &dongle->mt;
+	int i;
+
+	seq_printf(s, "hits %u\n", mt->efuse_hits);
+	seq_printf(s, "misses %u\n", mt->efuse_misses);
+
+	for (i = 0; i < XONE_MT_EFUSE_SIZE; i += XONE_MT_EFUSE_BLOCK_SIZE)
+		if (test_bit(i / XONE_MT_EFUSE_BLOCK_SIZE, mt->efuse_valid))
+			seq_printf(s, "%04x: %*ph\n", i,
+				   XONE_MT_EFUSE_BLOCK_SIZE, mt->efuse + i);
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_survey(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+	struct xone_mt76 *mt = &dongle->mt;
+	struct xone_mt76_survey *survey;
+	int i;
+
+	seq_printf(s, "channel %u\n", mt->channel ? mt->channel->index : 0);
+	seq_printf(s, "changes %u\n", mt->channel_changes);
+	seq_puts(s, "index busy idle false_cca score penalty\n");
+
+	for (i = 0; i < XONE_MT_NUM_CHANNELS; i++) {
+		survey = &mt->survey[i];
+		seq_printf(s, "%u %u %u %u %u %u\n", mt->channels[i].index,
+			   survey->busy, survey->idle, survey->false_cca,
+			   survey->score, mt->penalty[i]);
+	}
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_links(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+	struct xone_dongle_client *client;
+	struct xone_dongle_link_stats link;
+	u8 addr[ETH_ALEN];
+	unsigned long flags;
+	int i;
+
+	seq_puts(s, "wcid address rx_frames rssi rssi_avg tx_frames tx_failed tx_retries per client\n");
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		spin_lock_irqsave(&dongle->clients_lock, flags);
+
+		client = dongle->clients[i];
+		if (client) {
+			memcpy(addr, client->address, ETH_ALEN);
+			link = client->link;
+		}
+
+		spin_unlock_irqrestore(&dongle->clients_lock, flags);
+
+		if (!client)
+			continue;
+
+		/* packet error rate in permille */
+		seq_printf(s, "%d %pM %lu %d %ld %lu %lu %lu %lu %*phN\n",
+			   i + 1, addr, link.rx_frames, link.rssi,
+			   -(long)ewma_xone_rssi_read(&link.rssi_avg),
+			   link.tx_frames, link.tx_failed, link.tx_retries,
+			   link.tx_frames ?
+			   link.tx_failed * 1000 / link.tx_frames : 0,
+			   link.client_len, link.client);
+	}
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_rates(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+	struct xone_dongle_client *client;
+	struct xone_dongle_rate_ctrl rate;
+	u32 retry = dongle->mt.tx_retry_cfg;
+	unsigned long flags;
+	int i;
+
+	seq_printf(s, "adaptation %d\n", READ_ONCE(tx_adaptation));
+	seq_printf(s, "retry_short %lu\n",
+		   FIELD_GET(MT_TX_RETRY_CFG_SHORT_LIMIT, retry));
+	seq_printf(s, "retry_long %lu\n",
+		   FIELD_GET(MT_TX_RETRY_CFG_LONG_LIMIT, retry));
+	seq_puts(s, "wcid index per retries good\n");
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		spin_lock_irqsave(&dongle->clients_lock, flags);
 
-	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
 		client = dongle->clients[i];
+		if (client)
+			rate = client->rate;
+
+		spin_unlock_irqrestore(&dongle->clients_lock, flags);
+
 		if (!client)
 			continue;
 
-		gip_destroy_adapter(client->adapter);
+		seq_printf(s, "%d %u %u %u.%u %d\n", i + 1, rate.index,
+			   rate.last_per, rate.last_retries / 10,
+			   rate.last_retries % 10, rate.good);
+	}
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_recovery(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+
+	seq_printf(s, "coredumps %u\n", dongle->coredumps);
+	seq_printf(s, "recoveries %u\n", dongle->recoveries);
+	seq_printf(s, "failures %u\n", dongle->recovery_failures);
+	seq_printf(s, "last_ms %lld\n", dongle->recovery_ms);
+	seq_printf(s, "watchdog_step %d\n", dongle->watchdog_step);
+	seq_printf(s, "urb_restarts %u\n",
+		   dongle->watchdog_counts[XONE_DONGLE_RECOVER_URBS]);
+	seq_printf(s, "radio_resets %u\n",
+		   dongle->watchdog_counts[XONE_DONGLE_RECOVER_RADIO]);
+	seq_printf(s, "firmware_reloads %u\n",
+		   dongle->watchdog_counts[XONE_DONGLE_RECOVER_FIRMWARE]);
+	seq_printf(s, "usb_resets %u\n",
+		   dongle->watchdog_counts[XONE_DONGLE_RECOVER_USB]);
+
+	return 0;
+}
+
+static int xone_dongle_debugfs_power(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle = dev_get_drvdata(s->private);
+
+	seq_printf(s, "hold %d\n", dongle->pm_hold);
+	seq_printf(s, "idle_suspends %u\n", dongle->idle_suspends);
+	seq_printf(s, "resume_us %lld\n", dongle->resume_us);
+	seq_printf(s, "resume_avg_us %lu\n",
+		   ewma_xone_latency_read(&dongle->resume_latency));
+	seq_printf(s, "power_off_ms %lld\n", dongle->pwr_off_ms);
+	seq_printf(s, "power_off_timeouts %u\n", dongle->pwr_off_timeouts);
+
+	return 0;
+}
+
+static void xone_dongle_init_debugfs(struct xone_dongle *dongle)
+{
+	struct device *dev = dongle->mt.dev;
+
+	dongle->debugfs = debugfs_create_dir(dev_name(dev),
+					     xone_dongle_debugfs_root);
+
+	debugfs_create_devm_seqfile(dev, "tx_queues", dongle->debugfs,
+				    xone_dongle_debugfs_tx_queues);
+	debugfs_create_devm_seqfile(dev, "rx_memory", dongle->debugfs,
+				    xone_dongle_debugfs_rx_memory);
+	debugfs_create_devm_seqfile(dev, "rx_timing", dongle->debugfs,
+				    xone_dongle_debugfs_rx_timing);
+	debugfs_create_devm_seqfile(dev, "events", dongle->debugfs,
+				    xone_dongle_debugfs_events);
+	debugfs_create_devm_seqfile(dev, "association", dongle->debugfs,
+				    xone_dongle_debugfs_association);
+	debugfs_create_devm_seqfile(dev, "firmware", dongle->debugfs,
+				    xone_dongle_debugfs_firmware);
+	debugfs_create_devm_seqfile(dev, "registers", dongle->debugfs,
+				    xone_dongle_debugfs_registers);
+	debugfs_create_devm_seqfile(dev, "efuse", dongle->debugfs,
+				    xone_dongle_debugfs_efuse);
+	debugfs_create_devm_seqfile(dev, "survey", dongle->debugfs,
+				    xone_dongle_debugfs_survey);
+	debugfs_create_devm_seqfile(dev, "links", dongle->debugfs,
+				    xone_dongle_debugfs_links);
+	debugfs_create_devm_seqfile(dev, "rates", dongle->debugfs,
+				    xone_dongle_debugfs_rates);
+	debugfs_create_devm_seqfile(dev, "recovery", dongle->debugfs,
+				    xone_dongle_debugfs_recovery);
+	debugfs_create_devm_seqfile(dev, "power", dongle->debugfs,
+				    xone_dongle_debugfs_power);
+}
+
+static void xone_dongle_destroy(struct xone_dongle *dongle)
+{
+	struct xone_dongle_client *client;
+	int i;
+
+	mutex_lock(&xone_dongle_list_lock);
+	list_del(&dongle->node);
+	mutex_unlock(&xone_dongle_list_lock);
+
+	debugfs_remove_recursive(dongle->debugfs);
+	cancel_delayed_work_sync(&dongle->rx_tune_work);
+	cancel_delayed_work_sync(&dongle->survey_work);
+	cancel_delayed_work_sync(&dongle->stats_work);
+	cancel_delayed_work_sync(&dongle->watchdog_work);
+	usb_kill_anchored_urbs(&dongle->rx_cmd.urbs_busy);
+	usb_kill_anchored_urbs(&dongle->rx_wlan.urbs_busy);
+
+	/* no more chunks after the RX URBs have been killed */
+	cancel_delayed_work_sync(&dongle->coredump_work);
+	skb_queue_purge(&dongle->coredump_skbs);
+
+	/* failed associations queue removal events */
+	flush_workqueue(dongle->event_wq);
+	flush_workqueue(dongle->assoc_wq);
+	destroy_workqueue(dongle->event_wq);
+	destroy_workqueue(dongle->assoc_wq);
+	cancel_delayed_work_sync(&dongle->pairing_work);
+
+	/* scheduled by the stats work and resume */
+	cancel_work_sync(&dongle->pm_work);
+
+	for (i = 0; i < XONE_DONGLE_MAX_CLIENTS; i++) {
+		client = dongle->clients[i];
+		if (!client)
+			continue;
+
+		if (client->adapter)
+			gip_destroy_adapter(client->adapter);
 		kfree(client);
 		dongle->clients[i] = NULL;
 	}
 
-	usb_kill_anchored_urbs(&dongle->urbs_out_busy);
+	xone_dongle_free_tx_pool(&dongle->tx_data);
+	xone_dongle_free_tx_pool(&dongle->tx_audio);
 
-	while ((urb = usb_get_from_anchor(&dongle->urbs_out_idle)))
-		usb_free_urb(urb);
+	xone_dongle_free_urbs_in(&dongle->rx_cmd);
+	xone_dongle_free_urbs_in(&dongle->rx_wlan);
 
-	while ((urb = usb_get_from_anchor(&dongle->urbs_in_idle))) {
-		usb_free_coherent(urb->dev, urb->transfer_buffer_length,
-				  urb->transfer_buffer, urb->transfer_dma);
-		usb_free_urb(urb);
+	xone_mt76_kill_commands(&dongle->mt);
+	mutex_destroy(&dongle->pairing_lock);
+	mutex_destroy(&dongle->mt.cmd_lock);
+}
+
+static struct usb_driver xone_dongle_driver;
+
+/* a failed bring-up would leave the interface bound but dead */
+static void xone_dongle_release(struct xone_dongle *dongle)
+{
+	struct usb_interface *intf = to_usb_interface(dongle->mt.dev);
+	struct usb_device *udev = dongle->mt.udev;
+	int err;
+
+	/* device is locked or suspended during system sleep transitions */
+	do {
+		err = usb_lock_device_for_reset(udev, intf);
+		if (err == -EHOSTUNREACH)
+			msleep(100);
+	} while (err == -EBUSY || err == -EHOSTUNREACH);
+
+	/* fails if the driver gets unbound in the meantime */
+	if (err)
+		return;
+
+	dev_warn(dongle->mt.dev, "%s: releasing interface\n", __func__);
+
+	dongle->releasing = true;
+	usb_driver_release_interface(&xone_dongle_driver, intf);
+	usb_unlock_device(udev);
+}
+
+static void xone_dongle_bring_up(struct work_struct *work)
+{
+	struct xone_dongle *dongle = container_of(work, typeof(*dongle),
+						  init_work);
+	struct usb_interface *intf = to_usb_interface(dongle->mt.dev);
+	struct usb_device *udev = dongle->mt.udev;
+	ktime_t start = ktime_get();
+	int err;
+
+	err = xone_dongle_init(dongle);
+	if (err) {
+		dev_err(dongle->mt.dev, "%s: init failed: %d\n", __func__, err);
+		usb_kill_anchored_urbs(&dongle->rx_cmd.urbs_busy);
+		usb_kill_anchored_urbs(&dongle->rx_wlan.urbs_busy);
+		goto err_signal;
 	}
 
-	mutex_destroy(&dongle->pairing_lock);
+	schedule_delayed_work(&dongle->rx_tune_work,
+			      XONE_DONGLE_RX_TUNE_INTERVAL);
+	schedule_delayed_work(&dongle->survey_work, XONE_DONGLE_SURVEY_IDLE);
+	schedule_delayed_work(&dongle->stats_work, XONE_DONGLE_STATS_INTERVAL);
+	queue_delayed_work(dongle->event_wq, &dongle->watchdog_work,
+			   XONE_DONGLE_WATCHDOG_INTERVAL);
+
+	/* enable USB remote wakeup and autosuspend */
+	intf->needs_remote_wakeup = true;
+	device_wakeup_enable(&udev->dev);
+	pm_runtime_set_autosuspend_delay(&udev->dev,
+					 idle_timeout * MSEC_PER_SEC);
+	usb_enable_autosuspend(udev);
+
+	smp_store_release(&dongle->ready, true);
+
+	dev_dbg(dongle->mt.dev, "%s: ready, time=%lldms\n", __func__,
+		ktime_ms_delta(ktime_get(), start));
+
+err_signal:
+	dongle->init_err = err;
+	complete_all(&dongle->init_done);
+	usb_autopm_put_interface(intf);
+
+	/* system sleep no longer waits for bring-up */
+	if (err)
+		xone_dongle_release(dongle);
 }
 
 static int xone_dongle_probe(struct usb_interface *intf,
 			     const struct usb_device_id *id)
 {
 	struct xone_dongle *dongle;
-	int err;
 
 	dongle = devm_kzalloc(&intf->dev, sizeof(*dongle), GFP_KERNEL);
 	if (!dongle)
@@ -922,32 +2963,61 @@ static int xone_dongle_probe(struct usb_interface *intf,
 
 	dongle->mt.dev = &intf->dev;
 	dongle->mt.udev = interface_to_usbdev(intf);
+	xone_mt76_init_commands(&dongle->mt);
 
+	/* device lock is held, bring-up must not take it for the reset */
+	usb_set_intfdata(intf, dongle);
+	dongle->resetting = true;
 	usb_reset_device(dongle->mt.udev);
+	dongle->resetting = false;
 
 	dongle->event_wq = alloc_ordered_workqueue("xone_dongle", 0);
 	if (!dongle->event_wq)
 		return -ENOMEM;
 
+	dongle->assoc_wq = alloc_workqueue("xone_dongle_assoc", WQ_UNBOUND, 0);
+	if (!dongle->assoc_wq) {
+		destroy_workqueue(dongle->event_wq);
+		return -ENOMEM;
+	}
+
+	xone_dongle_init_events(dongle);
+
 	mutex_init(&dongle->pairing_lock);
 	INIT_DELAYED_WORK(&dongle->pairing_work, xone_dongle_pairing_timeout);
 	spin_lock_init(&dongle->clients_lock);
 	init_waitqueue_head(&dongle->disconnect_wait);
-
-	err = xone_dongle_init(dongle);
-	if (err) {
-		xone_dongle_destroy(dongle);
-		return err;
-	}
-
-	usb_set_intfdata(intf, dongle);
-
-	/* enable USB remote wakeup and autosuspend */
-	intf->needs_remote_wakeup = true;
-	device_wakeup_enable(&dongle->mt.udev->dev);
-	pm_runtime_set_autosuspend_delay(&dongle->mt.udev->dev,
-					 XONE_DONGLE_SUSPEND_DELAY);
-	usb_enable_autosuspend(dongle->mt.udev);
+	mutex_init(&dongle->pm_lock);
+	INIT_WORK(&dongle->pm_work, xone_dongle_pm_work);
+	ewma_xone_latency_init(&dongle->resume_latency);
+	INIT_DELAYED_WORK(&dongle->rx_tune_work, xone_dongle_rx_tune);
+	INIT_DELAYED_WORK(&dongle->survey_work, xone_dongle_survey);
+	INIT_DELAYED_WORK(&dongle->stats_work, xone_dongle_collect_stats);
+	skb_queue_head_init(&dongle->coredump_skbs);
+	INIT_DELAYED_WORK(&dongle->coredump_work, xone_dongle_coredump);
+	INIT_WORK(&dongle->restore_work, xone_dongle_restore_work);
+	INIT_DELAYED_WORK(&dongle->watchdog_work, xone_dongle_watchdog);
+	INIT_WORK(&dongle->init_work, xone_dongle_bring_up);
+	init_completion(&dongle->init_done);
+
+	xone_dongle_init_tx_pool(&dongle->tx_data, XONE_DONGLE_QUEUE_DATA);
+	xone_dongle_init_tx_pool(&dongle->tx_audio, XONE_DONGLE_QUEUE_AUDIO);
+	xone_dongle_init_rx_pool(dongle, &dongle->rx_cmd, XONE_MT_EP_IN_CMD,
+				 XONE_DONGLE_LEN_CMD_PKT);
+	xone_dongle_init_rx_pool(dongle, &dongle->rx_wlan, XONE_MT_EP_IN_WLAN,
+				 clamp_val(rx_wlan_buf_len,
+					   XONE_DONGLE_LEN_CMD_PKT,
+					   XONE_DONGLE_LEN_WLAN_PKT));
+
+	xone_dongle_init_debugfs(dongle);
+
+	mutex_lock(&xone_dongle_list_lock);
+	list_add_tail(&dongle->node, &xone_dongle_list);
+	mutex_unlock(&xone_dongle_list_lock);
+
+	/* keep device resumed until bring-up has finished */
+	usb_autopm_get_interface_no_resume(intf);
+	queue_work(system_unbound_wq, &dongle->init_work);
 
 	return 0;
 }
@@ -957,11 +3027,17 @@ static void xone_dongle_disconnect(struct usb_interface *intf)
 	struct xone_dongle *dongle = usb_get_intfdata(intf);
 	int err;
 
+	/* bring-up itself releases the interface after failures */
+	if (!dongle->releasing)
+		cancel_work_sync(&dongle->init_work);
+
 	/* can fail during USB device removal */
-	err = xone_dongle_power_off_clients(dongle);
-	if (err)
-		dev_dbg(dongle->mt.dev, "%s: power off failed: %d\n",
-			__func__, err);
+	if (dongle->ready) {
+		err = xone_dongle_power_off_clients(dongle);
+		if (err)
+			dev_dbg(dongle->mt.dev, "%s: power off failed: %d\n",
+				__func__, err);
+	}
 
 	xone_dongle_destroy(dongle);
 	usb_set_intfdata(intf, NULL);
@@ -972,34 +3048,156 @@ static int xone_dongle_suspend(struct usb_interface *intf, pm_message_t message)
 	struct xone_dongle *dongle = usb_get_intfdata(intf);
 	int err;
 
-	err = xone_dongle_power_off_clients(dongle);
-	if (err)
-		dev_err(dongle->mt.dev, "%s: power off failed: %d\n",
-			__func__, err);
+	/* bring-up never takes the device lock, waiting is safe */
+	if (!PMSG_IS_AUTO(message))
+		wait_for_completion(&dongle->init_done);
 
-	usb_kill_anchored_urbs(&dongle->urbs_in_busy);
-	usb_kill_anchored_urbs(&dongle->urbs_out_busy);
+	if (!smp_load_acquire(&dongle->ready))
+		return completion_done(&dongle->init_done) ? 0 : -EBUSY;
+
+	/* idle clients stay connected during autosuspend */
+	if (!PMSG_IS_AUTO(message)) {
+		err = xone_dongle_power_off_clients(dongle);
+		if (err)
+			dev_err(dongle->mt.dev, "%s: power off failed: %d\n",
+				__func__, err);
+	}
+
+	/* clients get restored through the command URBs */
+	flush_work(&dongle->restore_work);
+
+	/* stop new packets before killing the TX URBs */
+	WRITE_ONCE(dongle->asleep, true);
+	xone_dongle_plug_tx(dongle, &dongle->tx_data, true);
+	xone_dongle_plug_tx(dongle, &dongle->tx_audio, true);
+
+	cancel_delayed_work_sync(&dongle->rx_tune_work);
+	cancel_delayed_work_sync(&dongle->survey_work);
+	cancel_delayed_work_sync(&dongle->stats_work);
+	cancel_delayed_work_sync(&dongle->watchdog_work);
+	usb_kill_anchored_urbs(&dongle->rx_cmd.urbs_busy);
+	usb_kill_anchored_urbs(&dongle->rx_wlan.urbs_busy);
+	usb_kill_anchored_urbs(&dongle->tx_data.urbs_busy);
+	usb_kill_anchored_urbs(&dongle->tx_audio.urbs_busy);
 	cancel_delayed_work_sync(&dongle->pairing_work);
+	cancel_delayed_work_sync(&dongle->coredump_work);
+	skb_queue_purge(&dongle->coredump_skbs);
+
+	err = xone_mt76_suspend_radio(&dongle->mt);
+	if (err) {
+		WRITE_ONCE(dongle->asleep, false);
+		xone_dongle_plug_tx(dongle, &dongle->tx_data, false);
+		xone_dongle_plug_tx(dongle, &dongle->tx_audio, false);
+		return err;
+	}
 
-	return xone_mt76_suspend_radio(&dongle->mt);
+	if (PMSG_IS_AUTO(message) && atomic_read(&dongle->client_count))
+		dongle->idle_suspends++;
+
+	return 0;
+}
+
+/* called on every resume exit path */
+static void xone_dongle_record_resume(struct xone_dongle *dongle,
+				      ktime_t start)
+{
+	dongle->resume_us = ktime_us_delta(ktime_get(), start);
+	ewma_xone_latency_add(&dongle->resume_latency, dongle->resume_us);
+
+	WRITE_ONCE(dongle->asleep, false);
+	xone_dongle_plug_tx(dongle, &dongle->tx_data, false);
+	xone_dongle_plug_tx(dongle, &dongle->tx_audio, false);
+
+	/* hold reference again if resuming got too slow */
+	schedule_work(&dongle->pm_work);
 }
 
 static int xone_dongle_resume(struct usb_interface *intf)
 {
 	struct xone_dongle *dongle = usb_get_intfdata(intf);
-	struct urb *urb;
+	ktime_t start = ktime_get();
 	int err;
 
-	while ((urb = usb_get_from_anchor(&dongle->urbs_in_idle))) {
-		usb_anchor_urb(urb, &dongle->urbs_in_busy);
-		usb_free_urb(urb);
+	/* bring-up failed */
+	if (!smp_load_acquire(&dongle->ready))
+		return dongle->init_err;
 
-		err = usb_submit_urb(urb, GFP_KERNEL);
-		if (err)
-			return err;
+	err = xone_dongle_resume_urbs_in(&dongle->rx_cmd);
+	if (err)
+		goto err_record;
+
+	err = xone_dongle_resume_urbs_in(&dongle->rx_wlan);
+	if (err)
+		goto err_record;
+
+	schedule_delayed_work(&dongle->rx_tune_work,
+			      XONE_DONGLE_RX_TUNE_INTERVAL);
+	schedule_delayed_work(&dongle->survey_work, XONE_DONGLE_SURVEY_IDLE);
+	schedule_delayed_work(&dongle->stats_work, XONE_DONGLE_STATS_INTERVAL);
+	queue_delayed_work(dongle->event_wq, &dongle->watchdog_work,
+			   XONE_DONGLE_WATCHDOG_INTERVAL);
+
+	err = xone_mt76_resume_radio(&dongle->mt);
+	if (err) {
+		dev_warn(dongle->mt.dev, "%s: resume radio failed: %d\n",
+			 __func__, err);
+		err = xone_dongle_restore(dongle);
+		if (!err)
+			xone_dongle_queue_restore(dongle);
 	}
 
-	return xone_mt76_resume_radio(&dongle->mt);
+err_record:
+	xone_dongle_record_resume(dongle, start);
+
+	return err;
+}
+
+static int xone_dongle_reset_resume(struct usb_interface *intf)
+{
+	struct xone_dongle *dongle = usb_get_intfdata(intf);
+	ktime_t start = ktime_get();
+	int err;
+
+	/* bring-up failed */
+	if (!smp_load_acquire(&dongle->ready))
+		return dongle->init_err;
+
+	err = xone_dongle_resume_urbs_in(&dongle->rx_cmd);
+	if (err)
+		goto err_record;
+
+	err = xone_dongle_resume_urbs_in(&dongle->rx_wlan);
+	if (err)
+		goto err_record;
+
+	schedule_delayed_work(&dongle->rx_tune_work,
+			      XONE_DONGLE_RX_TUNE_INTERVAL);
+	schedule_delayed_work(&dongle->survey_work, XONE_DONGLE_SURVEY_IDLE);
+	schedule_delayed_work(&dongle->stats_work, XONE_DONGLE_STATS_INTERVAL);
+	queue_delayed_work(dongle->event_wq, &dongle->watchdog_work,
+			   XONE_DONGLE_WATCHDOG_INTERVAL);
+
+	err = xone_dongle_restore(dongle);
+	if (!err)
+		xone_dongle_queue_restore(dongle);
+
+err_record:
+	xone_dongle_record_resume(dongle, start);
+
+	return err;
+}
+
+static int xone_dongle_pre_reset(struct usb_interface *intf)
+{
+	struct xone_dongle *dongle = usb_get_intfdata(intf);
+
+	/* rebind after external resets, firmware state gets lost */
+	return dongle->resetting ? 0 : 1;
+}
+
+static int xone_dongle_post_reset(struct usb_interface *intf)
+{
+	return 0;
 }
 
 static void xone_dongle_shutdown(struct device *dev)
@@ -1008,6 +3206,9 @@ static void xone_dongle_shutdown(struct device *dev)
 	struct xone_dongle *dongle = usb_get_intfdata(intf);
 	int err;
 
+	if (!smp_load_acquire(&dongle->ready))
+		return;
+
 	err = xone_dongle_power_off_clients(dongle);
 	if (err)
 		dev_err(dongle->mt.dev, "%s: power off failed: %d\n",
@@ -1028,6 +3229,9 @@ static struct usb_driver xone_dongle_driver = {
 	.disconnect = xone_dongle_disconnect,
 	.suspend = xone_dongle_suspend,
 	.resume = xone_dongle_resume,
+	.reset_resume = xone_dongle_reset_resume,
+	.pre_reset = xone_dongle_pre_reset,
+	.post_reset = xone_dongle_post_reset,
 	.id_table = xone_dongle_id_table,
 #if LINUX_VERSION_CODE < KERNEL_VERSION(6, 8, 0)
 	.drvwrap.driver.shutdown = xone_dongle_shutdown,
@@ -1039,7 +3243,56 @@ static struct usb_driver xone_dongle_driver = {
 	.soft_unbind = true,
 };
 
-module_usb_driver(xone_dongle_driver);
+static int xone_dongle_channels_show(struct seq_file *s, void *data)
+{
+	struct xone_dongle *dongle;
+	struct xone_mt76_channel *chan;
+
+	seq_puts(s, "device channel score clients\n");
+
+	mutex_lock(&xone_dongle_list_lock);
+
+	list_for_each_entry(dongle, &xone_dongle_list, node) {
+		chan = dongle->channel;
+		if (!chan)
+			continue;
+
+		seq_printf(s, "%s %u %u %d\n", dev_name(dongle->mt.dev),
+			   chan->index,
+			   dongle->mt.survey[chan - dongle->mt.channels].score,
+			   atomic_read(&dongle->client_count));
+	}
+
+	mutex_unlock(&xone_dongle_list_lock);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(xone_dongle_channels);
+
+static int __init xone_dongle_module_init(void)
+{
+	int err;
+
+	xone_dongle_debugfs_root = debugfs_create_dir("xone-dongle", NULL);
+	debugfs_create_file("channels", 0444, xone_dongle_debugfs_root, NULL,
+			    &xone_dongle_channels_fops);
+
+	err = usb_register(&xone_dongle_driver);
+	if (err)
+		debugfs_remove_recursive(xone_dongle_debugfs_root);
+
+	return err;
+}
+
+static void __exit xone_dongle_module_exit(void)
+{
+	usb_deregister(&xone_dongle_driver);
+	debugfs_remove_recursive(xone_dongle_debugfs_root);
+}
+
+module_init(xone_dongle_module_init);
+module_exit(xone_dongle_module_exit);
 
 MODULE_DEVICE_TABLE(usb, xone_dongle_id_table);
 MODULE_AUTHOR("Severin von Wnuck-Lipinski <severinvonw@outlook.de>");
@@ -6,6 +6,7 @@
 #include <linux/slab.h>
 #include <linux/bitfield.h>
 #include <linux/delay.h>
+#include <linux/iopoll.h>
 #include <linux/usb.h>
 #include <linux/firmware.h>
 #include <linux/ieee80211.h>
@@ -17,6 +18,9 @@
 
 #define XONE_MT_POLL_RETRIES 50
 
+/* firmware DMA completion timeout in us */
+#define XONE_MT_FW_POLL_TIMEOUT 500000
+
 #define XONE_MT_RF_PATCH 0x0130
 #define XONE_MT_FW_LOAD_IVB 0x12
 #define XONE_MT_FW_ILM_OFFSET 0x080000
@@ -30,7 +34,14 @@
 #define XONE_MT_CH_5G_LOW 0x01
 #define XONE_MT_CH_5G_HIGH 0x02
 
-#define XONE_MT_WCID_KEY_LEN 16
+/* max number of register/value pairs per random write command */
+#define XONE_MT_MAX_RANDOM_WRITES 24
+
+/* default retry limits (short: 15, long: 31) */
+#define XONE_MT_TX_RETRY_CFG 0x47d01f0f
+
+/* time spent on each channel during evaluation (in ms) */
+#define XONE_MT_SURVEY_DWELL 20
 
 /* commands specific to the dongle's firmware */
 enum xone_mt76_ms_command {
@@ -51,6 +62,11 @@ enum xone_mt76_wow_traffic {
 	XONE_MT_WOW_TO_HOST = 0x01,
 };
 
+struct xone_mt76_reg {
+	u32 addr;
+	u32 val;
+};
+
 struct xone_mt76_msg_load_cr {
 	u8 mode;
 	u8 temperature;
@@ -72,6 +88,7 @@ struct xone_mt76_msg_switch_channel {
 static u32 xone_mt76_read_register(struct xone_mt76 *mt, u32 addr)
 {
 	u8 req = MT_VEND_MULTI_READ;
+	u32 val = 0;
 	int ret;
 
 	if (addr & MT_VEND_TYPE_CFG) {
@@ -79,6 +96,8 @@ static u32 xone_mt76_read_register(struct xone_mt76 *mt, u32 addr)
 		addr &= ~MT_VEND_TYPE_CFG;
 	}
 
+	mutex_lock(&mt->cmd_lock);
+
 	ret = usb_control_msg(mt->udev, usb_rcvctrlpipe(mt->udev, 0), req,
 			      USB_DIR_IN | USB_TYPE_VENDOR, addr >> 16, addr,
 			      &mt->control_data, sizeof(mt->control_data),
@@ -86,13 +105,15 @@ static u32 xone_mt76_read_register(struct xone_mt76 *mt, u32 addr)
 	if (ret != sizeof(mt->control_data))
 		ret = -EREMOTEIO;
 
-	if (ret < 0) {
+	if (ret < 0)
 		dev_err(mt->dev, "%s: control message failed: %d\n",
 			__func__, ret);
-		return 0;
-	}
+	else
+		val = le32_to_cpu(mt->control_data);
 
-	return le32_to_cpu(mt->control_data);
+	mutex_unlock(&mt->cmd_lock);
+
+	return val;
 }
 
 static void xone_mt76_write_register(struct xone_mt76 *mt, u32 addr, u32 val)
@@ -105,12 +126,16 @@ static void xone_mt76_write_register(struct xone_mt76 *mt, u32 addr, u32 val)
 		addr &= ~MT_VEND_TYPE_CFG;
 	}
 
+	mutex_lock(&mt->cmd_lock);
+
 	mt->control_data = cpu_to_le32(val);
 
 	ret = usb_control_msg(mt->udev, usb_sndctrlpipe(mt->udev, 0), req,
 			      USB_DIR_OUT | USB_TYPE_VENDOR, addr >> 16, addr,
 			      &mt->control_data, sizeof(mt->control_data),
 			      XONE_MT_USB_TIMEOUT);
+	mutex_unlock(&mt->cmd_lock);
+
 	if (ret != sizeof(mt->control_data))
 		ret = -EREMOTEIO;
 
@@ -144,29 +169,60 @@ static bool xone_mt76_poll(struct xone_mt76 *mt, u32 offset, u32 mask, u32 val)
 	return false;
 }
 
-static int xone_mt76_read_efuse(struct xone_mt76 *mt, u16 addr,
-				void *data, int len)
+static int xone_mt76_load_efuse_block(struct xone_mt76 *mt, u16 block)
 {
-	u32 ctrl, offset, val;
-	int i, remaining;
+	u32 ctrl, val;
+	int i;
 
 	ctrl = xone_mt76_read_register(mt, MT_EFUSE_CTRL);
 	ctrl &= ~(MT_EFUSE_CTRL_AIN | MT_EFUSE_CTRL_MODE);
 	ctrl |= MT_EFUSE_CTRL_KICK;
-	ctrl |= FIELD_PREP(MT_EFUSE_CTRL_AIN, addr & ~0x0f);
+	ctrl |= FIELD_PREP(MT_EFUSE_CTRL_AIN, block);
 	ctrl |= FIELD_PREP(MT_EFUSE_CTRL_MODE, MT_EE_READ);
 	xone_mt76_write_register(mt, MT_EFUSE_CTRL, ctrl);
 
 	if (!xone_mt76_poll(mt, MT_EFUSE_CTRL, MT_EFUSE_CTRL_KICK, 0))
 		return -ETIMEDOUT;
 
-	for (i = 0; i < len; i += sizeof(u32)) {
-		/* block data offset (multiple of 32 bits) */
-		offset = (addr & GENMASK(3, 2)) + i;
-		val = xone_mt76_read_register(mt, MT_EFUSE_DATA_BASE + offset);
-		remaining = min_t(int, len - i, sizeof(u32));
+	for (i = 0; i < XONE_MT_EFUSE_BLOCK_SIZE; i += sizeof(u32)) {
+		val = xone_mt76_read_register(mt, MT_EFUSE_DATA_BASE + i);
+		memcpy(mt->efuse + block + i, &val, sizeof(val));
+	}
+
+	__set_bit(block / XONE_MT_EFUSE_BLOCK_SIZE, mt->efuse_valid);
+
+	return 0;
+}
+
+static int xone_mt76_read_efuse(struct xone_mt76 *mt, u16 addr,
+				void *data, int len)
+{
+	/* reads start at the 32-bit word containing the address */
+	u16 start = addr & ~0x03;
+	u16 block, offset;
+	int i, chunk, err;
 
-		memcpy(data + i, &val, remaining);
+	if (len < 0 || start + len > XONE_MT_EFUSE_SIZE)
+		return -EINVAL;
+
+	for (i = 0; i < len; i += chunk) {
+		block = (start + i) & ~0x0f;
+		offset = (start + i) & 0x0f;
+		chunk = min_t(int, len - i, XONE_MT_EFUSE_BLOCK_SIZE - offset);
+
+		/* EFUSE is read-only, each block gets read at most once */
+		if (test_bit(block / XONE_MT_EFUSE_BLOCK_SIZE,
+			     mt->efuse_valid)) {
+			mt->efuse_hits++;
+		} else {
+			mt->efuse_misses++;
+
+			err = xone_mt76_load_efuse_block(mt, block);
+			if (err)
+				return err;
+		}
+
+		memcpy(data + i, mt->efuse + block + offset, chunk);
 	}
 
 	return 0;
@@ -214,13 +270,226 @@ static int xone_mt76_send_command(struct xone_mt76 *mt, struct sk_buff *skb,
 
 	xone_mt76_prep_command(skb, cmd);
 
+	mutex_lock(&mt->cmd_lock);
 	err = usb_bulk_msg(mt->udev, usb_sndbulkpipe(mt->udev, XONE_MT_EP_OUT),
 			   skb->data, skb->len, NULL, XONE_MT_USB_TIMEOUT);
+	mutex_unlock(&mt->cmd_lock);
 	consume_skb(skb);
 
 	return err;
 }
 
+void xone_mt76_init_commands(struct xone_mt76 *mt)
+{
+	int i;
+
+	mutex_init(&mt->cmd_lock);
+	spin_lock_init(&mt->cmd_seq_lock);
+	init_waitqueue_head(&mt->cmd_seq_wait);
+	init_usb_anchor(&mt->cmd_urbs);
+
+	for (i = 0; i < XONE_MT_NUM_CMD_SEQ; i++) {
+		mt->cmds[i].mt = mt;
+		init_completion(&mt->cmds[i].sent);
+		init_completion(&mt->cmds[i].done);
+	}
+}
+
+void xone_mt76_kill_commands(struct xone_mt76 *mt)
+{
+	/* waiters get woken up with an error */
+	usb_kill_anchored_urbs(&mt->cmd_urbs);
+}
+
+static int xone_mt76_get_seq(struct xone_mt76 *mt)
+{
+	unsigned long busy, flags;
+	int seq;
+
+	spin_lock_irqsave(&mt->cmd_seq_lock, flags);
+
+	/* timed out numbers might still receive a late response */
+	busy = mt->cmd_seq_used | mt->cmd_seq_stale;
+	seq = find_next_zero_bit(&busy, XONE_MT_NUM_CMD_SEQ,
+				 XONE_MT_CMD_SEQ_FIRST);
+	if (seq == XONE_MT_NUM_CMD_SEQ && mt->cmd_seq_stale) {
+		mt->cmd_seq_stale = 0;
+		seq = find_next_zero_bit(&mt->cmd_seq_used,
+					 XONE_MT_NUM_CMD_SEQ,
+					 XONE_MT_CMD_SEQ_FIRST);
+	}
+
+	if (seq < XONE_MT_NUM_CMD_SEQ)
+		set_bit(seq, &mt->cmd_seq_used);
+	else
+		seq = 0;
+
+	spin_unlock_irqrestore(&mt->cmd_seq_lock, flags);
+
+	return seq;
+}
+
+static void xone_mt76_put_seq(struct xone_mt76 *mt, int seq, bool stale)
+{
+	struct xone_mt76_cmd *cmd = &mt->cmds[seq];
+	unsigned long flags;
+
+	usb_free_urb(cmd->urb);
+	consume_skb(cmd->skb);
+	cmd->urb = NULL;
+	cmd->skb = NULL;
+
+	spin_lock_irqsave(&mt->cmd_seq_lock, flags);
+	clear_bit(seq, &mt->cmd_seq_used);
+	if (stale)
+		set_bit(seq, &mt->cmd_seq_stale);
+	spin_unlock_irqrestore(&mt->cmd_seq_lock, flags);
+
+	wake_up(&mt->cmd_seq_wait);
+}
+
+static void xone_mt76_complete_command_urb(struct urb *urb)
+{
+	struct xone_mt76_cmd *cmd = urb->context;
+
+	cmd->err = urb->status;
+	complete(&cmd->sent);
+
+	/* firmware does not respond to failed transfers */
+	if (urb->status || READ_ONCE(cmd->mt->cmd_no_response))
+		complete(&cmd->done);
+}
+
+bool xone_mt76_complete_command(struct xone_mt76 *mt, u8 seq)
+{
+	unsigned long flags;
+	bool found = false;
+
+	if (seq < XONE_MT_CMD_SEQ_FIRST || seq >= XONE_MT_NUM_CMD_SEQ)
+		return false;
+
+	spin_lock_irqsave(&mt->cmd_seq_lock, flags);
+
+	/* late response to a timed out command */
+	if (__test_and_clear_bit(seq, &mt->cmd_seq_stale)) {
+		found = true;
+	} else if (test_bit(seq, &mt->cmd_seq_used)) {
+		atomic_inc(&mt->cmd_responses);
+		complete(&mt->cmds[seq].done);
+		found = true;
+	}
+
+	spin_unlock_irqrestore(&mt->cmd_seq_lock, flags);
+
+	return found;
+}
+
+/* returns the sequence number to wait for */
+static int xone_mt76_send_command_async(struct xone_mt76 *mt,
+					struct sk_buff *skb,
+					enum mt76_mcu_cmd cmd)
+{
+	struct xone_mt76_cmd *slot;
+	int seq = 0;
+	int err;
+
+	/* all sequence numbers in use */
+	if (!wait_event_timeout(mt->cmd_seq_wait,
+				(seq = xone_mt76_get_seq(mt)),
+				msecs_to_jiffies(XONE_MT_USB_TIMEOUT))) {
+		kfree_skb(skb);
+		return -EBUSY;
+	}
+
+	slot = &mt->cmds[seq];
+	slot->skb = skb;
+	slot->err = 0;
+	reinit_completion(&slot->sent);
+	reinit_completion(&slot->done);
+
+	slot->urb = usb_alloc_urb(0, GFP_KERNEL);
+	if (!slot->urb) {
+		err = -ENOMEM;
+		goto err_put_seq;
+	}
+
+	xone_mt76_prep_message(skb, MT_MCU_MSG_TYPE_CMD |
+			       FIELD_PREP(MT_MCU_MSG_PORT, MT_CPU_TX_PORT) |
+			       FIELD_PREP(MT_MCU_MSG_CMD_TYPE, cmd) |
+			       FIELD_PREP(MT_MCU_MSG_CMD_SEQ, seq));
+
+	usb_fill_bulk_urb(slot->urb, mt->udev,
+			  usb_sndbulkpipe(mt->udev, XONE_MT_EP_OUT),
+			  skb->data, skb->len,
+			  xone_mt76_complete_command_urb, slot);
+	usb_anchor_urb(slot->urb, &mt->cmd_urbs);
+
+	/* keep order with synchronous commands */
+	mutex_lock(&mt->cmd_lock);
+	err = usb_submit_urb(slot->urb, GFP_KERNEL);
+	mutex_unlock(&mt->cmd_lock);
+
+	if (err) {
+		usb_unanchor_urb(slot->urb);
+		goto err_put_seq;
+	}
+
+	mt->cmd_async++;
+
+	return seq;
+
+err_put_seq:
+	xone_mt76_put_seq(mt, seq, false);
+
+	return err;
+}
+
+static int xone_mt76_wait_command(struct xone_mt76 *mt, int seq)
+{
+	struct xone_mt76_cmd *cmd = &mt->cmds[seq];
+	unsigned long timeout = msecs_to_jiffies(XONE_MT_USB_TIMEOUT);
+	bool stale = false;
+	int err;
+
+	if (wait_for_completion_timeout(&cmd->done, timeout)) {
+		/* response can overtake the URB completion */
+		wait_for_completion(&cmd->sent);
+		err = cmd->err;
+	} else if (completion_done(&cmd->sent) && !cmd->err) {
+		/* transfer succeeded, fall back to unconfirmed commands */
+		if (!xchg(&mt->cmd_no_response, true))
+			dev_warn(mt->dev, "%s: no response for seq %d\n",
+				 __func__, seq);
+
+		mt->cmd_timeouts++;
+		stale = true;
+		err = 0;
+	} else {
+		usb_kill_urb(cmd->urb);
+		mt->cmd_timeouts++;
+		stale = true;
+		err = -ETIMEDOUT;
+	}
+
+	xone_mt76_put_seq(mt, seq, stale);
+
+	return err;
+}
+
+/* waits for all commands, even after errors */
+static int xone_mt76_wait_commands(struct xone_mt76 *mt, int *seqs, int count)
+{
+	int i, err, ret = 0;
+
+	for (i = 0; i < count; i++) {
+		err = xone_mt76_wait_command(mt, seqs[i]);
+		if (err && !ret)
+			ret = err;
+	}
+
+	return ret;
+}
+
 static int xone_mt76_send_wlan(struct xone_mt76 *mt, struct sk_buff *skb)
 {
 	struct mt76_txwi txwi = {};
@@ -245,8 +514,10 @@ static int xone_mt76_send_wlan(struct xone_mt76 *mt, struct sk_buff *skb)
 			       MT_TXD_INFO_WIV |
 			       MT_TXD_INFO_80211);
 
+	mutex_lock(&mt->cmd_lock);
 	err = usb_bulk_msg(mt->udev, usb_sndbulkpipe(mt->udev, XONE_MT_EP_OUT),
 			   skb->data, skb->len, NULL, XONE_MT_USB_TIMEOUT);
+	mutex_unlock(&mt->cmd_lock);
 	consume_skb(skb);
 
 	return err;
@@ -299,22 +570,92 @@ static int xone_mt76_send_ms_command(struct xone_mt76 *mt,
 	return xone_mt76_send_command(mt, skb, MT_CMD_INIT_GAIN_OP);
 }
 
-static int xone_mt76_write_burst(struct xone_mt76 *mt, u32 idx,
-				 void *data, int len)
+static struct sk_buff *xone_mt76_alloc_burst(u32 idx, void *data, int len)
 {
 	struct sk_buff *skb;
 
 	skb = xone_mt76_alloc_message(sizeof(idx) + len, GFP_KERNEL);
 	if (!skb)
-		return -ENOMEM;
+		return NULL;
 
 	/* register offset in memory */
 	put_unaligned_le32(idx + MT_MCU_MEMMAP_WLAN, skb_put(skb, sizeof(idx)));
 	skb_put_data(skb, data, len);
 
+	return skb;
+}
+
+static int xone_mt76_write_burst(struct xone_mt76 *mt, u32 idx,
+				 void *data, int len)
+{
+	struct sk_buff *skb = xone_mt76_alloc_burst(idx, data, len);
+
+	if (!skb)
+		return -ENOMEM;
+
 	return xone_mt76_send_command(mt, skb, MT_CMD_BURST_WRITE);
 }
 
+static int xone_mt76_queue_burst(struct xone_mt76 *mt, u32 idx,
+				 void *data, int len)
+{
+	struct sk_buff *skb = xone_mt76_alloc_burst(idx, data, len);
+
+	if (!skb)
+		return -ENOMEM;
+
+	return xone_mt76_send_command_async(mt, skb, MT_CMD_BURST_WRITE);
+}
+
+static int xone_mt76_write_registers(struct xone_mt76 *mt,
+				     const struct xone_mt76_reg *regs,
+				     int count)
+{
+	struct sk_buff *skb;
+	int seqs[XONE_MT_NUM_CMD_SEQ - XONE_MT_CMD_SEQ_FIRST];
+	int i, len, seq, queued = 0;
+	int err = 0;
+
+	/* processed in order with other MCU commands */
+	/* pipelined, only wait once all commands have been queued */
+	while (count && queued < ARRAY_SIZE(seqs)) {
+		len = min(count, XONE_MT_MAX_RANDOM_WRITES);
+
+		skb = xone_mt76_alloc_message(len * sizeof(u32) * 2,
+					      GFP_KERNEL);
+		if (!skb) {
+			err = -ENOMEM;
+			break;
+		}
+
+		for (i = 0; i < len; i++) {
+			put_unaligned_le32(regs[i].addr + MT_MCU_MEMMAP_WLAN,
+					   skb_put(skb, sizeof(u32)));
+			put_unaligned_le32(regs[i].val,
+					   skb_put(skb, sizeof(u32)));
+		}
+
+		seq = xone_mt76_send_command_async(mt, skb,
+						   MT_CMD_RANDOM_WRITE);
+		if (seq < 0) {
+			err = seq;
+			break;
+		}
+
+		seqs[queued++] = seq;
+		mt->reg_writes += len;
+		mt->reg_commands++;
+
+		regs += len;
+		count -= len;
+	}
+
+	if (!err && count)
+		err = -E2BIG;
+
+	return xone_mt76_wait_commands(mt, seqs, queued) ?: err;
+}
+
 int xone_mt76_set_led_mode(struct xone_mt76 *mt, enum xone_mt76_led_mode mode)
 {
 	struct sk_buff *skb;
@@ -409,39 +750,107 @@ static int xone_mt76_calibrate(struct xone_mt76 *mt,
 	return xone_mt76_send_command(mt, skb, MT_CMD_CALIBRATION_OP);
 }
 
-static int xone_mt76_send_firmware_part(struct xone_mt76 *mt, u32 offset,
-					const u8 *data, u32 len)
+static void xone_mt76_complete_firmware(struct urb *urb)
+{
+	complete(urb->context);
+}
+
+static struct sk_buff *xone_mt76_alloc_firmware_chunk(const u8 *data,
+						      u32 pos, u32 len)
 {
 	struct sk_buff *skb;
-	u32 pos, chunk_len, complete;
-	int err;
+	u32 chunk_len = min_t(u32, len - pos, XONE_MT_FW_CHUNK_SIZE);
 
-	for (pos = 0; pos < len; pos += XONE_MT_FW_CHUNK_SIZE) {
-		chunk_len = min_t(u32, len - pos, XONE_MT_FW_CHUNK_SIZE);
+	skb = xone_mt76_alloc_message(chunk_len, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	skb_put_data(skb, data + pos, chunk_len);
+	xone_mt76_prep_command(skb, 0);
 
-		skb = xone_mt76_alloc_message(chunk_len, GFP_KERNEL);
-		if (!skb)
-			return -ENOMEM;
+	return skb;
+}
 
-		skb_put_data(skb, data + pos, chunk_len);
+static int xone_mt76_send_firmware_part(struct xone_mt76 *mt, u32 offset,
+					const u8 *data, u32 len)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	unsigned long timeout = msecs_to_jiffies(XONE_MT_USB_TIMEOUT);
+	struct sk_buff *skb, *next;
+	struct urb *urb;
+	u32 pos, chunk_len, next_pos, reg;
+	int err = 0;
+
+	urb = usb_alloc_urb(0, GFP_KERNEL);
+	if (!urb)
+		return -ENOMEM;
+
+	skb = xone_mt76_alloc_firmware_chunk(data, 0, len);
+	if (!skb) {
+		err = -ENOMEM;
+		goto err_free_urb;
+	}
+
+	for (pos = 0; pos < len; pos = next_pos) {
+		chunk_len = min_t(u32, len - pos, XONE_MT_FW_CHUNK_SIZE);
+		next_pos = pos + chunk_len;
 		chunk_len = roundup(chunk_len, sizeof(u32));
 
+		/* single DMA descriptor, programmed once previous chunk is done */
 		xone_mt76_write_register(mt, MT_FCE_DMA_ADDR | MT_VEND_TYPE_CFG,
 					 offset + pos);
 		xone_mt76_write_register(mt, MT_FCE_DMA_LEN | MT_VEND_TYPE_CFG,
 					 chunk_len << 16);
 
-		err = xone_mt76_send_command(mt, skb, 0);
+		reinit_completion(&done);
+		usb_fill_bulk_urb(urb, mt->udev,
+				  usb_sndbulkpipe(mt->udev, XONE_MT_EP_OUT),
+				  skb->data, skb->len,
+				  xone_mt76_complete_firmware, &done);
+
+		err = usb_submit_urb(urb, GFP_KERNEL);
 		if (err)
-			return err;
+			goto err_free_skb;
+
+		/* prepare next chunk while the current one is in flight */
+		next = NULL;
+		if (next_pos < len)
+			next = xone_mt76_alloc_firmware_chunk(data, next_pos,
+							      len);
+
+		if (wait_for_completion_timeout(&done, timeout)) {
+			err = urb->status;
+		} else {
+			usb_kill_urb(urb);
+			err = -ETIMEDOUT;
+		}
 
-		complete = 0xc0000000 | (chunk_len << 16);
-		if (!xone_mt76_poll(mt, MT_FCE_DMA_LEN | MT_VEND_TYPE_CFG,
-				    0xffffffff, complete))
-			return -ETIMEDOUT;
+		consume_skb(skb);
+		skb = next;
+
+		if (err)
+			goto err_free_skb;
+
+		if (next_pos < len && !skb) {
+			err = -ENOMEM;
+			goto err_free_urb;
+		}
+
+		/* transfer takes less than a millisecond, avoid long sleeps */
+		err = read_poll_timeout(xone_mt76_read_register, reg,
+					reg == (0xc0000000 | (chunk_len << 16)),
+					20, XONE_MT_FW_POLL_TIMEOUT, false,
+					mt, MT_FCE_DMA_LEN | MT_VEND_TYPE_CFG);
+		if (err)
+			goto err_free_skb;
 	}
 
-	return 0;
+err_free_skb:
+	kfree_skb(skb);
+err_free_urb:
+	usb_free_urb(urb);
+
+	return err;
 }
 
 static int xone_mt76_send_firmware(struct xone_mt76 *mt,
@@ -449,6 +858,7 @@ static int xone_mt76_send_firmware(struct xone_mt76 *mt,
 {
 	const struct mt76_fw_header *hdr;
 	u32 ilm_len, dlm_len;
+	ktime_t start;
 	int err;
 
 	if (fw->size < sizeof(*hdr))
@@ -475,15 +885,28 @@ static int xone_mt76_send_firmware(struct xone_mt76 *mt,
 	xone_mt76_write_register(mt, MT_FCE_SKIP_FS, 0x03);
 
 	/* send instruction local memory */
+	start = ktime_get();
 	err = xone_mt76_send_firmware_part(mt, XONE_MT_FW_ILM_OFFSET,
 					   fw->data + sizeof(*hdr), ilm_len);
 	if (err)
 		return err;
 
+	mt->fw_ilm_us = ktime_us_delta(ktime_get(), start);
+
 	/* send data local memory */
-	return xone_mt76_send_firmware_part(mt, XONE_MT_FW_DLM_OFFSET,
-					    fw->data + sizeof(*hdr) + ilm_len,
-					    dlm_len);
+	start = ktime_get();
+	err = xone_mt76_send_firmware_part(mt, XONE_MT_FW_DLM_OFFSET,
+					   fw->data + sizeof(*hdr) + ilm_len,
+					   dlm_len);
+	if (err)
+		return err;
+
+	mt->fw_dlm_us = ktime_us_delta(ktime_get(), start);
+
+	dev_dbg(mt->dev, "%s: ilm=%lldus, dlm=%lldus\n", __func__,
+		mt->fw_ilm_us, mt->fw_dlm_us);
+
+	return 0;
 }
 
 static int xone_mt76_reset_firmware(struct xone_mt76 *mt)
@@ -561,6 +984,12 @@ xone_mt76_channels[XONE_MT_NUM_CHANNELS] = {
 	{ 0xa5, XONE_MT_CH_5G_HIGH, MT_PHY_BW_80, MT_CH_5G_UNII_3, false, 0 },
 };
 
+/* valid before the channel table has been evaluated */
+u8 xone_mt76_channel_index(int i)
+{
+	return xone_mt76_channels[i].index;
+}
+
 static int xone_mt76_set_channel_candidates(struct xone_mt76 *mt)
 {
 	struct sk_buff *skb;
@@ -628,15 +1057,67 @@ static int xone_mt76_get_channel_power(struct xone_mt76 *mt,
 	return 0;
 }
 
+static void xone_mt76_read_survey(struct xone_mt76 *mt,
+				  struct xone_mt76_survey *survey)
+{
+	u32 total;
+
+	/* counters are cleared on read */
+	survey->busy = xone_mt76_read_register(mt, MT_CH_BUSY);
+	survey->idle = xone_mt76_read_register(mt, MT_CH_IDLE);
+	survey->false_cca = FIELD_GET(MT_RX_STAT_1_CCA_ERRORS,
+				      xone_mt76_read_register(mt, MT_RX_STAT_1));
+
+	total = survey->busy + survey->idle;
+	if (!total) {
+		survey->score = XONE_MT_SURVEY_MAX_SCORE;
+		return;
+	}
+
+	/* busy time in permille, one point per 10 false CCAs per second */
+	survey->score = div_u64((u64)survey->busy * 1000, total) +
+			min_t(u64, div_u64((u64)survey->false_cca * 100000,
+					   total), 1000);
+}
+
+struct xone_mt76_channel *xone_mt76_best_channel(struct xone_mt76 *mt)
+{
+	u32 score, best_score = U32_MAX;
+	int i, best = 0;
+
+	/* prefer later channels on equal scores, like the original driver */
+	for (i = 0; i < XONE_MT_NUM_CHANNELS; i++) {
+		score = mt->survey[i].score + mt->penalty[i];
+		if (score <= best_score) {
+			best = i;
+			best_score = score;
+		}
+	}
+
+	return &mt->channels[best];
+}
+
 static int xone_mt76_evaluate_channels(struct xone_mt76 *mt)
 {
 	struct xone_mt76_channel *chan;
+	struct xone_mt76_survey *survey;
 	int i, err;
 
 	memcpy(mt->channels, xone_mt76_channels, sizeof(xone_mt76_channels));
 
+	/* count TX, RX, NAV and EIFS time as busy, clear counters on read */
+	xone_mt76_write_register(mt, MT_CH_TIME_CFG,
+				 MT_CH_TIME_CFG_TIMER_EN |
+				 MT_CH_TIME_CFG_TX_AS_BUSY |
+				 MT_CH_TIME_CFG_RX_AS_BUSY |
+				 MT_CH_TIME_CFG_NAV_AS_BUSY |
+				 MT_CH_TIME_CFG_EIFS_AS_BUSY |
+				 MT_CH_CCA_RC_EN |
+				 FIELD_PREP(MT_CH_TIME_CFG_CH_TIMER_CLR, 1));
+
 	for (i = 0; i < XONE_MT_NUM_CHANNELS; i++) {
 		chan = &mt->channels[i];
+		survey = &mt->survey[i];
 
 		/* original driver increases power for channels 0x24 to 0x30 */
 		err = xone_mt76_get_channel_power(mt, chan);
@@ -647,17 +1128,20 @@ static int xone_mt76_evaluate_channels(struct xone_mt76 *mt)
 		if (err)
 			return err;
 
-		dev_dbg(mt->dev, "%s: channel=%u, power=%u\n", __func__,
-			chan->index, chan->power);
-	}
+		/* discard counters of previous channel */
+		xone_mt76_read_survey(mt, survey);
+		msleep(XONE_MT_SURVEY_DWELL);
+		xone_mt76_read_survey(mt, survey);
 
-	/* the last channel might not be the best one */
-	mt->channel = chan;
+		dev_dbg(mt->dev, "%s: channel=%u, power=%u, busy=%u, idle=%u, false_cca=%u, score=%u\n",
+			__func__, chan->index, chan->power, survey->busy,
+			survey->idle, survey->false_cca, survey->score);
+	}
 
 	return 0;
 }
 
-static int xone_mt76_init_channels(struct xone_mt76 *mt)
+static int xone_mt76_scan_channels(struct xone_mt76 *mt)
 {
 	int err;
 
@@ -671,6 +1155,33 @@ static int xone_mt76_init_channels(struct xone_mt76 *mt)
 	/* disable promiscuous mode */
 	xone_mt76_write_register(mt, MT_RX_FILTR_CFG, 0x017f17);
 
+	return 0;
+}
+
+int xone_mt76_survey_channel(struct xone_mt76 *mt)
+{
+	struct xone_mt76_survey survey;
+
+	/* counters accumulate since the last survey */
+	xone_mt76_read_survey(mt, &survey);
+	mt->survey[mt->channel - mt->channels] = survey;
+
+	return survey.score;
+}
+
+static int xone_mt76_init_channels(struct xone_mt76 *mt, bool restore)
+{
+	int err;
+
+	/* reuse result of previous evaluation */
+	if (!restore) {
+		err = xone_mt76_scan_channels(mt);
+		if (err)
+			return err;
+
+		mt->channel = xone_mt76_best_channel(mt);
+	}
+
 	dev_dbg(mt->dev, "%s: channel=%u\n", __func__, mt->channel->index);
 
 	mt->channel->scan = true;
@@ -745,7 +1256,6 @@ static int xone_mt76_calibrate_crystal(struct xone_mt76 *mt)
 	u8 trim[4];
 	u16 val;
 	s8 offset;
-	u32 ctrl;
 	int err;
 
 	err = xone_mt76_read_efuse(mt, MT_EE_XTAL_TRIM_2, trim, sizeof(trim));
@@ -772,15 +1282,22 @@ static int xone_mt76_calibrate_crystal(struct xone_mt76 *mt)
 			val = 0x14;
 	}
 
-	val = (val & GENMASK(6, 0)) + offset;
+	mt->crystal_trim = (val & GENMASK(6, 0)) + offset;
+
+	return 0;
+}
+
+static void xone_mt76_apply_crystal(struct xone_mt76 *mt)
+{
+	u32 ctrl;
+
 	ctrl = xone_mt76_read_register(mt, MT_XO_CTRL5 | MT_VEND_TYPE_CFG);
 	xone_mt76_write_register(mt, MT_XO_CTRL5 | MT_VEND_TYPE_CFG,
-				 (ctrl & ~MT_XO_CTRL5_C2_VAL) | (val << 8));
+				 (ctrl & ~MT_XO_CTRL5_C2_VAL) |
+				 (mt->crystal_trim << 8));
 	xone_mt76_write_register(mt, MT_XO_CTRL6 | MT_VEND_TYPE_CFG,
 				 MT_XO_CTRL6_C2_CTRL);
 	xone_mt76_write_register(mt, MT_CMB_CTRL, 0x0091a7ff);
-
-	return 0;
 }
 
 static int xone_mt76_calibrate_radio(struct xone_mt76 *mt)
@@ -815,8 +1332,64 @@ static int xone_mt76_calibrate_radio(struct xone_mt76 *mt)
 	return 0;
 }
 
-static void xone_mt76_init_registers(struct xone_mt76 *mt)
+static const struct xone_mt76_reg xone_mt76_mac_regs[] = {
+	{ MT_AUTO_RSP_CFG, 0x13 },
+	{ MT_MAX_LEN_CFG, 0x3e3fff },
+	{ MT_AMPDU_MAX_LEN_20M1S, 0xfffc9855 },
+	{ MT_AMPDU_MAX_LEN_20M2S, 0xff },
+	{ MT_BKOFF_SLOT_CFG, 0x0109 },
+	{ MT_PWR_PIN_CFG, 0 },
+	{ MT_EDCA_CFG_AC(0), 0x064320 },
+	{ MT_EDCA_CFG_AC(1), 0x0a4700 },
+	{ MT_EDCA_CFG_AC(2), 0x043238 },
+	{ MT_EDCA_CFG_AC(3), 0x03212f },
+	{ MT_TX_PIN_CFG, 0x150f0f },
+	{ MT_TX_SW_CFG0, 0x101001 },
+	{ MT_TX_SW_CFG1, 0x010000 },
+	{ MT_TXOP_CTRL_CFG, 0x10583f },
+	{ MT_TX_TIMEOUT_CFG, 0x0a0f90 },
+	{ MT_TX_RETRY_CFG, XONE_MT_TX_RETRY_CFG },
+	{ MT_CCK_PROT_CFG, 0x03f40003 },
+	{ MT_OFDM_PROT_CFG, 0x03f40003 },
+	{ MT_MM20_PROT_CFG, 0x01742004 },
+	{ MT_GF20_PROT_CFG, 0x01742004 },
+	{ MT_GF40_PROT_CFG, 0x03f42084 },
+	{ MT_EXP_ACK_TIME, 0x2c00dc },
+	{ MT_TX_ALC_CFG_2, 0x22160a00 },
+	{ MT_TX_ALC_CFG_3, 0x22160a76 },
+	{ MT_TX_ALC_CFG_0, 0x3f3f1818 },
+	{ MT_TX_ALC_CFG_4, 0x0606 },
+	{ MT_PIFS_TX_CFG, 0x060fff },
+	{ MT_RX_FILTR_CFG, 0x017f17 },
+	{ MT_LEGACY_BASIC_RATE, 0x017f },
+	{ MT_HT_BASIC_RATE, 0x8003 },
+	{ MT_PN_PAD_MODE, 0x02 },
+	{ MT_TXOP_HLDR_ET, 0x02 },
+	{ MT_TX_PROT_CFG6, 0xe3f42004 },
+	{ MT_TX_PROT_CFG7, 0xe3f42084 },
+	{ MT_TX_PROT_CFG8, 0xe3f42104 },
+	{ MT_DACCLK_EN_DLY_CFG, 0 },
+	{ MT_RF_PA_MODE_ADJ0, 0xee000000 },
+	{ MT_RF_PA_MODE_ADJ1, 0xee000000 },
+	{ MT_TX0_RF_GAIN_CORR, 0x0f3c3c3c },
+	{ MT_TX1_RF_GAIN_CORR, 0x0f3c3c3c },
+	{ MT_PBF_CFG, 0x1efebcf5 },
+	{ MT_PAUSE_ENABLE_CONTROL1, 0x0a },
+	{ MT_RF_BYPASS_0, 0x7f000000 },
+	{ MT_RF_SETTING_0, 0x1a800000 },
+	{ MT_XIFS_TIME_CFG, 0x33a40e0a },
+	{ MT_TX_RTS_CFG, 0 },
+	{ MT_BEACON_TIME_CFG, 0x0640 },
+	{ MT_EXT_CCA_CFG, 0xf0e4 },
+	{ MT_CH_TIME_CFG, 0x015f },
+};
+
+static int xone_mt76_init_registers(struct xone_mt76 *mt)
 {
+	ktime_t start = ktime_get();
+	int err;
+
+	/* MCU commands pass through USB DMA and FCE, write directly */
 	xone_mt76_write_register(mt, MT_MAC_SYS_CTRL,
 				 MT_MAC_SYS_CTRL_RESET_BBP |
 				 MT_MAC_SYS_CTRL_RESET_CSR);
@@ -836,56 +1409,20 @@ static void xone_mt76_init_registers(struct xone_mt76 *mt)
 	xone_mt76_write_register(mt, MT_MAC_SYS_CTRL,
 				 MT_MAC_SYS_CTRL_ENABLE_RX |
 				 MT_MAC_SYS_CTRL_ENABLE_TX);
-	xone_mt76_write_register(mt, MT_AUTO_RSP_CFG, 0x13);
-	xone_mt76_write_register(mt, MT_MAX_LEN_CFG, 0x3e3fff);
-	xone_mt76_write_register(mt, MT_AMPDU_MAX_LEN_20M1S, 0xfffc9855);
-	xone_mt76_write_register(mt, MT_AMPDU_MAX_LEN_20M2S, 0xff);
-	xone_mt76_write_register(mt, MT_BKOFF_SLOT_CFG, 0x0109);
-	xone_mt76_write_register(mt, MT_PWR_PIN_CFG, 0);
-	xone_mt76_write_register(mt, MT_EDCA_CFG_AC(0), 0x064320);
-	xone_mt76_write_register(mt, MT_EDCA_CFG_AC(1), 0x0a4700);
-	xone_mt76_write_register(mt, MT_EDCA_CFG_AC(2), 0x043238);
-	xone_mt76_write_register(mt, MT_EDCA_CFG_AC(3), 0x03212f);
-	xone_mt76_write_register(mt, MT_TX_PIN_CFG, 0x150f0f);
-	xone_mt76_write_register(mt, MT_TX_SW_CFG0, 0x101001);
-	xone_mt76_write_register(mt, MT_TX_SW_CFG1, 0x010000);
-	xone_mt76_write_register(mt, MT_TXOP_CTRL_CFG, 0x10583f);
-	xone_mt76_write_register(mt, MT_TX_TIMEOUT_CFG, 0x0a0f90);
-	xone_mt76_write_register(mt, MT_TX_RETRY_CFG, 0x47d01f0f);
-	xone_mt76_write_register(mt, MT_CCK_PROT_CFG, 0x03f40003);
-	xone_mt76_write_register(mt, MT_OFDM_PROT_CFG, 0x03f40003);
-	xone_mt76_write_register(mt, MT_MM20_PROT_CFG, 0x01742004);
-	xone_mt76_write_register(mt, MT_GF20_PROT_CFG, 0x01742004);
-	xone_mt76_write_register(mt, MT_GF40_PROT_CFG, 0x03f42084);
-	xone_mt76_write_register(mt, MT_EXP_ACK_TIME, 0x2c00dc);
-	xone_mt76_write_register(mt, MT_TX_ALC_CFG_2, 0x22160a00);
-	xone_mt76_write_register(mt, MT_TX_ALC_CFG_3, 0x22160a76);
-	xone_mt76_write_register(mt, MT_TX_ALC_CFG_0, 0x3f3f1818);
-	xone_mt76_write_register(mt, MT_TX_ALC_CFG_4, 0x0606);
-	xone_mt76_write_register(mt, MT_PIFS_TX_CFG, 0x060fff);
-	xone_mt76_write_register(mt, MT_RX_FILTR_CFG, 0x017f17);
-	xone_mt76_write_register(mt, MT_LEGACY_BASIC_RATE, 0x017f);
-	xone_mt76_write_register(mt, MT_HT_BASIC_RATE, 0x8003);
-	xone_mt76_write_register(mt, MT_PN_PAD_MODE, 0x02);
-	xone_mt76_write_register(mt, MT_TXOP_HLDR_ET, 0x02);
-	xone_mt76_write_register(mt, MT_TX_PROT_CFG6, 0xe3f42004);
-	xone_mt76_write_register(mt, MT_TX_PROT_CFG7, 0xe3f42084);
-	xone_mt76_write_register(mt, MT_TX_PROT_CFG8, 0xe3f42104);
-	xone_mt76_write_register(mt, MT_DACCLK_EN_DLY_CFG, 0);
-	xone_mt76_write_register(mt, MT_RF_PA_MODE_ADJ0, 0xee000000);
-	xone_mt76_write_register(mt, MT_RF_PA_MODE_ADJ1, 0xee000000);
-	xone_mt76_write_register(mt, MT_TX0_RF_GAIN_CORR, 0x0f3c3c3c);
-	xone_mt76_write_register(mt, MT_TX1_RF_GAIN_CORR, 0x0f3c3c3c);
-	xone_mt76_write_register(mt, MT_PBF_CFG, 0x1efebcf5);
-	xone_mt76_write_register(mt, MT_PAUSE_ENABLE_CONTROL1, 0x0a);
-	xone_mt76_write_register(mt, MT_RF_BYPASS_0, 0x7f000000);
-	xone_mt76_write_register(mt, MT_RF_SETTING_0, 0x1a800000);
-	xone_mt76_write_register(mt, MT_XIFS_TIME_CFG, 0x33a40e0a);
 	xone_mt76_write_register(mt, MT_FCE_L2_STUFF, 0x03ff0223);
-	xone_mt76_write_register(mt, MT_TX_RTS_CFG, 0);
-	xone_mt76_write_register(mt, MT_BEACON_TIME_CFG, 0x0640);
-	xone_mt76_write_register(mt, MT_EXT_CCA_CFG, 0xf0e4);
-	xone_mt76_write_register(mt, MT_CH_TIME_CFG, 0x015f);
+
+	err = xone_mt76_write_registers(mt, xone_mt76_mac_regs,
+					ARRAY_SIZE(xone_mt76_mac_regs));
+	if (err)
+		return err;
+
+	mt->tx_retry_cfg = XONE_MT_TX_RETRY_CFG;
+	mt->init_regs_us = ktime_us_delta(ktime_get(), start);
+
+	dev_dbg(mt->dev, "%s: time=%lldus, saved=%u\n", __func__,
+		mt->init_regs_us, mt->reg_writes - mt->reg_commands);
+
+	return 0;
 }
 
 static u16 xone_mt76_get_chip_id(struct xone_mt76 *mt)
@@ -898,13 +1435,10 @@ static u16 xone_mt76_get_chip_id(struct xone_mt76 *mt)
 	return (id[1] << 8) | id[2];
 }
 
-int xone_mt76_init_radio(struct xone_mt76 *mt)
+static int xone_mt76_setup_radio(struct xone_mt76 *mt, bool restore)
 {
 	int err;
 
-	dev_dbg(mt->dev, "%s: id=0x%04x\n", __func__,
-		xone_mt76_get_chip_id(mt));
-
 	err = xone_mt76_select_function(mt, MT_Q_SELECT, 1);
 	if (err)
 		return err;
@@ -917,12 +1451,19 @@ int xone_mt76_init_radio(struct xone_mt76 *mt)
 	if (err)
 		return err;
 
-	xone_mt76_init_registers(mt);
-
-	err = xone_mt76_calibrate_crystal(mt);
+	err = xone_mt76_init_registers(mt);
 	if (err)
 		return err;
 
+	/* crystal trim only depends on EFUSE */
+	if (!restore) {
+		err = xone_mt76_calibrate_crystal(mt);
+		if (err)
+			return err;
+	}
+
+	xone_mt76_apply_crystal(mt);
+
 	err = xone_mt76_init_address(mt);
 	if (err)
 		return err;
@@ -935,14 +1476,132 @@ int xone_mt76_init_radio(struct xone_mt76 *mt)
 	if (err)
 		return err;
 
-	err = xone_mt76_init_channels(mt);
+	err = xone_mt76_init_channels(mt, restore);
 	if (err)
 		return err;
 
 	/* mandatory delay after channel change */
 	msleep(1000);
 
-	return xone_mt76_set_pairing(mt, false);
+	err = xone_mt76_set_pairing(mt, false);
+	if (err)
+		return err;
+
+	mt->calibrated = true;
+
+	return 0;
+}
+
+int xone_mt76_init_radio(struct xone_mt76 *mt)
+{
+	dev_dbg(mt->dev, "%s: id=0x%04x\n", __func__,
+		xone_mt76_get_chip_id(mt));
+
+	return xone_mt76_setup_radio(mt, false);
+}
+
+int xone_mt76_restore_radio(struct xone_mt76 *mt)
+{
+	ktime_t start = ktime_get();
+	int err;
+
+	if (!mt->calibrated)
+		return xone_mt76_init_radio(mt);
+
+	err = xone_mt76_setup_radio(mt, true);
+	if (err)
+		return err;
+
+	dev_dbg(mt->dev, "%s: channel=%u, time=%lldms\n", __func__,
+		mt->channel->index, ktime_ms_delta(ktime_get(), start));
+
+	return 0;
+}
+
+int xone_mt76_change_channel(struct xone_mt76 *mt,
+			     struct xone_mt76_channel *chan)
+{
+	int err;
+
+	if (chan == mt->channel)
+		return 0;
+
+	mt->channel = chan;
+
+	err = xone_mt76_init_channels(mt, true);
+	if (err)
+		return err;
+
+	/* mandatory delay after channel change */
+	msleep(1000);
+
+	mt->channel_changes++;
+
+	return 0;
+}
+
+int xone_mt76_reselect_channel(struct xone_mt76 *mt, u32 margin)
+{
+	struct xone_mt76_channel *chan;
+	u32 cur, best;
+	int err;
+
+	err = xone_mt76_scan_channels(mt);
+	if (err)
+		return err;
+
+	chan = xone_mt76_best_channel(mt);
+	cur = mt->survey[mt->channel - mt->channels].score +
+	      mt->penalty[mt->channel - mt->channels];
+	best = mt->survey[chan - mt->channels].score +
+	       mt->penalty[chan - mt->channels];
+
+	dev_dbg(mt->dev, "%s: channel=%u, score=%u, best_channel=%u, best_score=%u\n",
+		__func__, mt->channel->index, cur, chan->index, best);
+
+	/* return to the current channel, skips the delay */
+	if (best + margin > cur)
+		return xone_mt76_init_channels(mt, true);
+
+	return xone_mt76_change_channel(mt, chan);
+}
+
+bool xone_mt76_read_tx_status(struct xone_mt76 *mt,
+			      struct xone_mt76_tx_status *stat)
+{
+	u32 stat1, stat2;
+
+	/* extended status must be read first, reading the FIFO pops it */
+	stat2 = xone_mt76_read_register(mt, MT_TX_STAT_FIFO_EXT);
+	stat1 = xone_mt76_read_register(mt, MT_TX_STAT_FIFO);
+	if (!(stat1 & MT_TX_STAT_FIFO_VALID))
+		return false;
+
+	stat->wcid = FIELD_GET(MT_TX_STAT_FIFO_WCID, stat1);
+	stat->success = stat1 & MT_TX_STAT_FIFO_SUCCESS;
+	stat->retries = FIELD_GET(MT_TX_STAT_FIFO_EXT_RETRY, stat2);
+	stat->rate = FIELD_GET(MT_TX_STAT_FIFO_RATE, stat1);
+
+	return true;
+}
+
+void xone_mt76_set_retry_limits(struct xone_mt76 *mt, u8 short_limit,
+				u8 long_limit)
+{
+	u32 val = XONE_MT_TX_RETRY_CFG;
+
+	val &= ~(MT_TX_RETRY_CFG_SHORT_LIMIT | MT_TX_RETRY_CFG_LONG_LIMIT);
+	val |= FIELD_PREP(MT_TX_RETRY_CFG_SHORT_LIMIT, short_limit) |
+	       FIELD_PREP(MT_TX_RETRY_CFG_LONG_LIMIT, long_limit);
+
+	if (val == mt->tx_retry_cfg)
+		return;
+
+	xone_mt76_write_register(mt, MT_TX_RETRY_CFG, val);
+	mt->tx_retry_cfg = val;
+
+	dev_dbg(mt->dev, "%s: short=%u, long=%u\n", __func__,
+		short_limit, long_limit);
 }
 
 int xone_mt76_suspend_radio(struct xone_mt76 *mt)
@@ -1092,6 +1751,20 @@ int xone_mt76_pair_client(struct xone_mt76 *mt, u8 *addr)
 	return xone_mt76_send_wlan(mt, skb);
 }
 
+int xone_mt76_restore_client(struct xone_mt76 *mt, u8 wcid, u8 *addr)
+{
+	u8 data[] = { wcid - 1, 0x00, 0x00, 0x00, 0x40, 0x1f, 0x00, 0x00 };
+	int err;
+
+	/* firmware state only, client is still associated */
+	err = xone_mt76_write_burst(mt, MT_WCID_ADDR(wcid), addr, ETH_ALEN);
+	if (err)
+		return err;
+
+	return xone_mt76_send_ms_command(mt, XONE_MT_ADD_CLIENT,
+					 data, sizeof(data));
+}
+
 int xone_mt76_associate_client(struct xone_mt76 *mt, u8 wcid, u8 *addr)
 {
 	struct sk_buff *skb;
@@ -1186,21 +1859,32 @@ int xone_mt76_set_client_key(struct xone_mt76 *mt, u8 wcid, u8 *key, int len)
 	__le32 attr = cpu_to_le32(FIELD_PREP(MT_WCID_ATTR_PKEY_MODE,
 					     MT_CIPHER_AES_CCMP) |
 				  MT_WCID_ATTR_PAIRWISE);
+	int seqs[3], count = 0;
 	int err;
 
 	if (len != XONE_MT_WCID_KEY_LEN)
 		return -EINVAL;
 
-	err = xone_mt76_write_burst(mt, MT_WCID_KEY(wcid), key, len);
-	if (err)
-		return err;
+	err = xone_mt76_queue_burst(mt, MT_WCID_KEY(wcid), key, len);
+	if (err < 0)
+		goto err_wait;
 
-	err = xone_mt76_write_burst(mt, MT_WCID_IV(wcid), iv, sizeof(iv));
-	if (err)
-		return err;
+	seqs[count++] = err;
+	err = xone_mt76_queue_burst(mt, MT_WCID_IV(wcid), iv, sizeof(iv));
+	if (err < 0)
+		goto err_wait;
+
+	seqs[count++] = err;
+	err = xone_mt76_queue_burst(mt, MT_WCID_ATTR(wcid),
+				    &attr, sizeof(attr));
+	if (err < 0)
+		goto err_wait;
+
+	seqs[count++] = err;
+	err = 0;
 
-	return xone_mt76_write_burst(mt, MT_WCID_ATTR(wcid),
-				     &attr, sizeof(attr));
+err_wait:
+	return xone_mt76_wait_commands(mt, seqs, count) ?: err;
 }
 
 int xone_mt76_remove_client(struct xone_mt76 *mt, u8 wcid)
@@ -1210,25 +1894,38 @@ int xone_mt76_remove_client(struct xone_mt76 *mt, u8 wcid)
 	u8 iv[8] = {};
 	u32 attr = 0;
 	u8 key[XONE_MT_WCID_KEY_LEN] = {};
+	int seqs[4], count = 0;
 	int err;
 
+	/* client must be removed before its WCID entry gets cleared */
 	err = xone_mt76_send_ms_command(mt, XONE_MT_REMOVE_CLIENT,
 					data, sizeof(data));
 	if (err)
 		return err;
 
-	err = xone_mt76_write_burst(mt, MT_WCID_ADDR(wcid), addr, sizeof(addr));
-	if (err)
-		return err;
+	err = xone_mt76_queue_burst(mt, MT_WCID_ADDR(wcid), addr, sizeof(addr));
+	if (err < 0)
+		goto err_wait;
 
-	err = xone_mt76_write_burst(mt, MT_WCID_IV(wcid), iv, sizeof(iv));
-	if (err)
-		return err;
+	seqs[count++] = err;
+	err = xone_mt76_queue_burst(mt, MT_WCID_IV(wcid), iv, sizeof(iv));
+	if (err < 0)
+		goto err_wait;
 
-	err = xone_mt76_write_burst(mt, MT_WCID_ATTR(wcid),
+	seqs[count++] = err;
+	err = xone_mt76_queue_burst(mt, MT_WCID_ATTR(wcid),
 				    &attr, sizeof(attr));
-	if (err)
-		return err;
+	if (err < 0)
+		goto err_wait;
+
+	seqs[count++] = err;
+	err = xone_mt76_queue_burst(mt, MT_WCID_KEY(wcid), key, sizeof(key));
+	if (err < 0)
+		goto err_wait;
+
+	seqs[count++] = err;
+	err = 0;
 
-	return xone_mt76_write_burst(mt, MT_WCID_KEY(wcid), key, sizeof(key));
+err_wait:
+	return xone_mt76_wait_commands(mt, seqs, count) ?: err;
 }
@@ -5,6 +5,11 @@
 
 #pragma once
 
+#include <linux/mutex.h>
+#include <linux/bitmap.h>
+#include <linux/completion.h>
+#include <linux/usb.h>
+
 #include "mt76_defs.h"
 
 #define XONE_MT_EP_IN_CMD 0x05
@@ -13,6 +18,23 @@
 
 #define XONE_MT_NUM_CHANNELS 12
 
+#define XONE_MT_WCID_KEY_LEN 16
+
+/* sequence numbers of asynchronous commands, 0 and 1 are reserved */
+#define XONE_MT_NUM_CMD_SEQ 16
+#define XONE_MT_CMD_SEQ_FIRST 2
+
+/* shadowed EFUSE region, read in blocks of 16 bytes */
+#define XONE_MT_EFUSE_SIZE 0xa0
+#define XONE_MT_EFUSE_BLOCK_SIZE 0x10
+
+/* retry limits of the register defaults */
+#define XONE_MT_RETRY_SHORT 15
+#define XONE_MT_RETRY_LONG 31
+
+/* channel with 100% busy time and excessive false CCAs */
+#define XONE_MT_SURVEY_MAX_SCORE 2000
+
 /* 802.11 frame subtype: reserved */
 #define XONE_MT_WLAN_RESERVED 0x70
 
@@ -23,6 +45,7 @@ enum xone_mt76_led_mode {
 };
 
 enum xone_mt76_event {
+	XONE_MT_EVT_CMD_DONE = 0x00,
 	XONE_MT_EVT_BUTTON = 0x04,
 	XONE_MT_EVT_CHANNELS = 0x0a,
 	XONE_MT_EVT_PACKET_RX = 0x0c,
@@ -51,29 +74,111 @@ struct xone_mt76_channel {
 	u8 power;
 };
 
+struct xone_mt76_survey {
+	u32 busy;
+	u32 idle;
+	u32 false_cca;
+	u32 score;
+};
+
+struct xone_mt76_tx_status {
+	u8 wcid;
+	bool success;
+	u8 retries;
+	u16 rate;
+};
+
+struct xone_mt76_cmd {
+	struct xone_mt76 *mt;
+	struct urb *urb;
+	struct sk_buff *skb;
+	struct completion sent;
+	struct completion done;
+	int err;
+};
+
 struct xone_mt76 {
 	struct device *dev;
 	struct usb_device *udev;
 
+	/* serializes access to the MCU command channel */
+	struct mutex cmd_lock;
+
+	/* asynchronous commands, indexed by sequence number */
+	spinlock_t cmd_seq_lock;
+	unsigned long cmd_seq_used;
+	unsigned long cmd_seq_stale;
+	wait_queue_head_t cmd_seq_wait;
+	struct xone_mt76_cmd cmds[XONE_MT_NUM_CMD_SEQ];
+	struct usb_anchor cmd_urbs;
+	bool cmd_no_response;
+
+	unsigned int cmd_async;
+	atomic_t cmd_responses;
+	unsigned int cmd_timeouts;
+
 	__le32 control_data;
 	u8 address[ETH_ALEN];
 
 	struct xone_mt76_channel channels[XONE_MT_NUM_CHANNELS];
 	struct xone_mt76_channel *channel;
+	struct xone_mt76_survey survey[XONE_MT_NUM_CHANNELS];
+
+	/* added to survey scores, avoids channels of other radios */
+	u32 penalty[XONE_MT_NUM_CHANNELS];
+	unsigned int channel_changes;
+
+	/* current value of MT_TX_RETRY_CFG */
+	u32 tx_retry_cfg;
+
+	/* results of first init, reused after device resets */
+	bool calibrated;
+	u16 crystal_trim;
+
+	/* firmware upload durations */
+	s64 fw_ilm_us;
+	s64 fw_dlm_us;
+
+	u8 efuse[XONE_MT_EFUSE_SIZE];
+	DECLARE_BITMAP(efuse_valid, XONE_MT_EFUSE_SIZE / XONE_MT_EFUSE_BLOCK_SIZE);
+	unsigned int efuse_hits;
+	unsigned int efuse_misses;
+
+	/* batched register writes */
+	unsigned int reg_writes;
+	unsigned int reg_commands;
+	s64 init_regs_us;
 };
 
+void xone_mt76_init_commands(struct xone_mt76 *mt);
+void xone_mt76_kill_commands(struct xone_mt76 *mt);
+bool xone_mt76_complete_command(struct xone_mt76 *mt, u8 seq);
+
 struct sk_buff *xone_mt76_alloc_message(int len, gfp_t gfp);
 void xone_mt76_prep_command(struct sk_buff *skb, enum mt76_mcu_cmd cmd);
 
 int xone_mt76_set_led_mode(struct xone_mt76 *mt, enum xone_mt76_led_mode mode);
 int xone_mt76_load_firmware(struct xone_mt76 *mt, const char *name);
 int xone_mt76_init_radio(struct xone_mt76 *mt);
+int xone_mt76_restore_radio(struct xone_mt76 *mt);
 int xone_mt76_suspend_radio(struct xone_mt76 *mt);
 int xone_mt76_resume_radio(struct xone_mt76 *mt);
 int xone_mt76_set_pairing(struct xone_mt76 *mt, bool enable);
 
+u8 xone_mt76_channel_index(int i);
+int xone_mt76_survey_channel(struct xone_mt76 *mt);
+struct xone_mt76_channel *xone_mt76_best_channel(struct xone_mt76 *mt);
+int xone_mt76_change_channel(struct xone_mt76 *mt,
+			     struct xone_mt76_channel *chan);
+int xone_mt76_reselect_channel(struct xone_mt76 *mt, u32 margin);
+bool xone_mt76_read_tx_status(struct xone_mt76 *mt,
+			      struct xone_mt76_tx_status *stat);
+void xone_mt76_set_retry_limits(struct xone_mt76 *mt, u8 short_limit,
+				u8 long_limit);
+
 int xone_mt76_pair_client(struct xone_mt76 *mt, u8 *addr);
 int xone_mt76_associate_client(struct xone_mt76 *mt, u8 wcid, u8 *addr);
+int xone_mt76_restore_client(struct xone_mt76 *mt, u8 wcid, u8 *addr);
 int xone_mt76_send_client_command(struct xone_mt76 *mt, u8 wcid, u8 *addr,
 				  enum xone_mt76_client_command cmd,
 				  u8 *data, int len);
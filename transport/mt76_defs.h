@@ -419,6 +419,8 @@
 #define MT_TX_TIMEOUT_CFG_ACKTO GENMASK(15, 8)
 
 #define MT_TX_RETRY_CFG 0x134c
+#define MT_TX_RETRY_CFG_SHORT_LIMIT GENMASK(7, 0)
+#define MT_TX_RETRY_CFG_LONG_LIMIT GENMASK(15, 8)
 #define MT_TX_LINK_CFG 0x1350
 #define MT_TX_CFACK_EN BIT(12)
 #define MT_VHT_HT_FBK_CFG0 0x1354
@@ -6,6 +6,7 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/usb.h>
+#include <linux/average.h>
 
 #include "../bus/bus.h"
 
@@ -13,10 +14,18 @@
 #define XONE_WIRED_INTF_AUDIO 1
 
 #define XONE_WIRED_NUM_DATA_URBS 8
+#define XONE_WIRED_MAX_DATA_IN_URBS 8
 #define XONE_WIRED_NUM_AUDIO_URBS 12
 #define XONE_WIRED_NUM_AUDIO_PKTS 8
 
 #define XONE_WIRED_LEN_DATA_PKT 64
+#define XONE_WIRED_MAX_OVERFLOW 64
+
+/* longer gaps between reports are idle periods */
+#define XONE_WIRED_MAX_ARRIVAL_US 100000
+
+/* report inter-arrival time in us */
+DECLARE_EWMA(xone_arrival, 4, 8);
 
 #define XONE_WIRED_VENDOR(vendor) \
 	.match_flags = USB_DEVICE_ID_MATCH_VENDOR | \
@@ -28,6 +37,12 @@
 	.bInterfaceProtocol = 0xd0, \
 	.bInterfaceNumber = XONE_WIRED_INTF_DATA,
 
+struct xone_wired_overflow {
+	struct list_head node;
+	int length;
+	u8 data[XONE_WIRED_LEN_DATA_PKT];
+};
+
 struct xone_wired {
 	struct usb_device *udev;
 
@@ -44,13 +59,74 @@ struct xone_wired {
 		int buffer_length_out;
 	} data_port, audio_port;
 
+	/* completed in submission order by the host controller */
+	struct urb *urbs_in[XONE_WIRED_MAX_DATA_IN_URBS];
+	int num_urbs_in;
+
+	/* reports per second over the last full second */
+	ktime_t rate_start;
+	unsigned int rate_reports;
+	unsigned int report_rate;
+
+	/* polling interval overrides in ms, 0 uses the advertised one */
+	struct mutex interval_lock;
+	unsigned int interval_in;
+	unsigned int interval_out;
+	u8 advertised_in;
+	u8 advertised_out;
+	int urb_interval_out;
+
+	ktime_t last_report;
+	struct ewma_xone_arrival arrival_avg;
+
+	/* data packets waiting for a free out URB, sent in order */
+	spinlock_t overflow_lock;
+	struct xone_wired_overflow *overflow;
+	int num_overflow;
+	struct list_head overflow_free;
+	struct list_head overflow_queued;
+	unsigned long tx_overflows;
+	unsigned long tx_drops;
+
+	/* packets get queued while the endpoints are reconfigured */
+	bool tx_held;
+
 	struct gip_adapter *adapter;
 };
 
+static unsigned int data_in_urbs = 4;
+module_param(data_in_urbs, uint, 0444);
+MODULE_PARM_DESC(data_in_urbs, "Number of in-flight interrupt IN URBs");
+
+static unsigned int tx_overflow_depth = 16;
+module_param(tx_overflow_depth, uint, 0444);
+MODULE_PARM_DESC(tx_overflow_depth, "Data packets queued when all out URBs are busy");
+
+static void xone_wired_update_rate(struct xone_wired *wired, ktime_t now)
+{
+	s64 elapsed = ktime_to_ns(ktime_sub(now, wired->rate_start));
+	s64 arrival = ktime_us_delta(now, wired->last_report);
+
+	if (wired->last_report && arrival <= XONE_WIRED_MAX_ARRIVAL_US)
+		ewma_xone_arrival_add(&wired->arrival_avg, arrival);
+
+	wired->last_report = now;
+	wired->rate_reports++;
+	if (elapsed < NSEC_PER_SEC)
+		return;
+
+	WRITE_ONCE(wired->report_rate,
+		   div64_s64((s64)wired->rate_reports * NSEC_PER_SEC,
+			     elapsed));
+	WRITE_ONCE(wired->rate_start, now);
+	wired->rate_reports = 0;
+}
+
 static void xone_wired_complete_data_in(struct urb *urb)
 {
 	struct xone_wired *wired = urb->context;
 	struct device *dev = wired->data_port.dev;
+	ktime_t now = ktime_get();
 	int err;
 
 	switch (urb->status) {
@@ -67,8 +143,10 @@ static void xone_wired_complete_data_in(struct urb *urb)
 	if (!urb->actual_length)
 		goto resubmit;
 
+	xone_wired_update_rate(wired, now);
+
 	err = gip_process_buffer(wired->adapter, urb->transfer_buffer,
-				 urb->actual_length);
+				 urb->actual_length, now);
 	if (err) {
 		dev_err(dev, "%s: process failed: %d\n", __func__, err);
 		print_hex_dump_debug("xone-wired packet: ",
@@ -108,7 +186,7 @@ static void xone_wired_complete_audio_in(struct urb *urb)
 
 		err = gip_process_buffer(wired->adapter,
 					 urb->transfer_buffer + desc->offset,
-					 desc->actual_length);
+					 desc->actual_length, ktime_get());
 		if (err)
 			dev_err(dev, "%s: process failed: %d\n", __func__, err);
 	}
@@ -119,6 +197,49 @@ static void xone_wired_complete_audio_in(struct urb *urb)
 		dev_dbg(dev, "%s: submit failed: %d\n", __func__, err);
 }
 
+static void xone_wired_flush_overflow(struct xone_wired *wired)
+{
+	struct xone_wired_port *port = &wired->data_port;
+	struct xone_wired_overflow *entry;
+	struct urb *urb;
+	int err;
+
+	lockdep_assert_held(&wired->overflow_lock);
+
+	if (wired->tx_held)
+		return;
+
+	while (!list_empty(&wired->overflow_queued)) {
+		urb = usb_get_from_anchor(&port->urbs_out_idle);
+		if (!urb)
+			break;
+
+		entry = list_first_entry(&wired->overflow_queued,
+					 typeof(*entry), node);
+		memcpy(urb->transfer_buffer, entry->data, entry->length);
+		urb->transfer_buffer_length = entry->length;
+		urb->interval = READ_ONCE(wired->urb_interval_out);
+		list_move_tail(&entry->node, &wired->overflow_free);
+		usb_anchor_urb(urb, &port->urbs_out_busy);
+
+		err = usb_submit_urb(urb, GFP_ATOMIC);
+		if (err) {
+			usb_unanchor_urb(urb);
+			usb_anchor_urb(urb, &port->urbs_out_idle);
+			wired->tx_drops++;
+		}
+
+		usb_free_urb(urb);
+
+		/* can fail during USB device removal */
+		if (err) {
+			dev_dbg(port->dev, "%s: submit failed: %d\n",
+				__func__, err);
+			break;
+		}
+	}
+}
+
 static void xone_wired_complete_out(struct urb *urb)
 {
 	struct xone_wired_port *port = urb->context;
@@ -126,32 +247,124 @@ static void xone_wired_complete_out(struct urb *urb)
 	usb_anchor_urb(urb, &port->urbs_out_idle);
 }
 
+static void xone_wired_complete_data_out(struct urb *urb)
+{
+	struct xone_wired *wired = urb->context;
+	unsigned long flags;
+
+	usb_anchor_urb(urb, &wired->data_port.urbs_out_idle);
+
+	switch (urb->status) {
+	case -ENOENT:
+	case -ECONNRESET:
+		/* killed packets never reached the device */
+		spin_lock_irqsave(&wired->overflow_lock, flags);
+		wired->tx_drops++;
+		spin_unlock_irqrestore(&wired->overflow_lock, flags);
+		return;
+	case -ESHUTDOWN:
+		return;
+	}
+
+	spin_lock_irqsave(&wired->overflow_lock, flags);
+	xone_wired_flush_overflow(wired);
+	spin_unlock_irqrestore(&wired->overflow_lock, flags);
+}
+
 static int xone_wired_init_data_in(struct xone_wired *wired)
 {
 	struct xone_wired_port *port = &wired->data_port;
 	struct urb *urb;
 	void *buf;
+	int count = clamp_val(data_in_urbs, 1, XONE_WIRED_MAX_DATA_IN_URBS);
+	int i, err;
 
-	urb = usb_alloc_urb(0, GFP_KERNEL);
-	if (!urb)
-		return -ENOMEM;
+	for (i = 0; i < count; i++) {
+		urb = usb_alloc_urb(0, GFP_KERNEL);
+		if (!urb)
+			return -ENOMEM;
 
-	port->urb_in = urb;
+		wired->urbs_in[i] = urb;
+		wired->num_urbs_in++;
 
-	buf = usb_alloc_coherent(wired->udev, XONE_WIRED_LEN_DATA_PKT,
-				 GFP_KERNEL, &urb->transfer_dma);
-	if (!buf)
-		return -ENOMEM;
+		buf = usb_alloc_coherent(wired->udev, XONE_WIRED_LEN_DATA_PKT,
+					 GFP_KERNEL, &urb->transfer_dma);
+		if (!buf)
+			return -ENOMEM;
 
-	usb_fill_int_urb(urb, wired->udev,
-			 usb_rcvintpipe(wired->udev,
-					port->ep_in->bEndpointAddress),
-			 buf, XONE_WIRED_LEN_DATA_PKT,
-			 xone_wired_complete_data_in, wired,
-			 port->ep_in->bInterval);
-	urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+		usb_fill_int_urb(urb, wired->udev,
+				 usb_rcvintpipe(wired->udev,
+						port->ep_in->bEndpointAddress),
+				 buf, XONE_WIRED_LEN_DATA_PKT,
+				 xone_wired_complete_data_in, wired,
+				 port->ep_in->bInterval);
+		urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+	}
 
-	return usb_submit_urb(urb, GFP_KERNEL);
+	wired->rate_start = ktime_get();
+
+	/* keep the endpoint busy while reports are being processed */
+	for (i = 0; i < wired->num_urbs_in; i++) {
+		err = usb_submit_urb(wired->urbs_in[i], GFP_KERNEL);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static u8 xone_wired_encode_interval(struct xone_wired *wired,
+				     unsigned int ms, u8 advertised)
+{
+	enum usb_device_speed speed = wired->udev->speed;
+
+	if (!ms)
+		return advertised;
+
+	/* interval is 2^(bInterval - 1) microframes */
+	if (speed == USB_SPEED_HIGH || speed >= USB_SPEED_SUPER)
+		return clamp(fls(ms << 3), 1, 16);
+
+	return clamp(ms, 1u, 255u);
+}
+
+static int xone_wired_urb_interval(struct xone_wired *wired,
+				   struct usb_endpoint_descriptor *ep)
+{
+	enum usb_device_speed speed = wired->udev->speed;
+
+	/* same conversion as usb_fill_int_urb */
+	if (speed == USB_SPEED_HIGH || speed >= USB_SPEED_SUPER)
+		return 1 << (clamp_val(ep->bInterval, 1, 16) - 1);
+
+	return ep->bInterval;
+}
+
+static void xone_wired_kill_urbs_in(struct xone_wired *wired)
+{
+	int i;
+
+	for (i = 0; i < wired->num_urbs_in; i++)
+		usb_kill_urb(wired->urbs_in[i]);
+}
+
+static void xone_wired_free_urbs_in(struct xone_wired *wired)
+{
+	struct urb *urb;
+	int i;
+
+	for (i = 0; i < wired->num_urbs_in; i++) {
+		urb = wired->urbs_in[i];
+		if (urb->transfer_buffer)
+			usb_free_coherent(urb->dev,
+					  urb->transfer_buffer_length,
+					  urb->transfer_buffer,
+					  urb->transfer_dma);
+		usb_free_urb(urb);
+		wired->urbs_in[i] = NULL;
+	}
+
+	wired->num_urbs_in = 0;
 }
 
 static int xone_wired_init_data_out(struct xone_wired *wired)
@@ -161,7 +374,19 @@ static int xone_wired_init_data_out(struct xone_wired *wired)
 	void *buf;
 	int i;
 
+	wired->num_overflow = min_t(unsigned int, tx_overflow_depth,
+				    XONE_WIRED_MAX_OVERFLOW);
+	wired->overflow = devm_kcalloc(port->dev, wired->num_overflow,
+				       sizeof(*wired->overflow), GFP_KERNEL);
+	if (wired->num_overflow && !wired->overflow)
+		return -ENOMEM;
+
+	for (i = 0; i < wired->num_overflow; i++)
+		list_add_tail(&wired->overflow[i].node, &wired->overflow_free);
+
 	port->buffer_length_out = XONE_WIRED_LEN_DATA_PKT;
+	wired->urb_interval_out = xone_wired_urb_interval(wired,
+							  port->ep_out);
 
 	for (i = 0; i < XONE_WIRED_NUM_DATA_URBS; i++) {
 		urb = usb_alloc_urb(0, GFP_KERNEL);
@@ -180,7 +405,7 @@ static int xone_wired_init_data_out(struct xone_wired *wired)
 				 usb_sndintpipe(wired->udev,
 						port->ep_out->bEndpointAddress),
 				 buf, XONE_WIRED_LEN_DATA_PKT,
-				 xone_wired_complete_out, port,
+				 xone_wired_complete_data_out, wired,
 				 port->ep_out->bInterval);
 		urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
 	}
@@ -206,6 +431,108 @@ static void xone_wired_free_urbs(struct xone_wired_port *port)
 	}
 }
 
+static bool xone_wired_is_overflow(struct xone_wired *wired, void *context)
+{
+	struct xone_wired_overflow *entry = context;
+
+	return entry >= wired->overflow &&
+	       entry < wired->overflow + wired->num_overflow;
+}
+
+static int xone_wired_get_data_buffer(struct xone_wired *wired,
+				      struct gip_adapter_buffer *buf)
+{
+	struct xone_wired_overflow *entry;
+	struct urb *urb = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&wired->overflow_lock, flags);
+
+	/* queued packets must be sent first */
+	if (!wired->tx_held && list_empty(&wired->overflow_queued))
+		urb = usb_get_from_anchor(&wired->data_port.urbs_out_idle);
+
+	if (urb) {
+		spin_unlock_irqrestore(&wired->overflow_lock, flags);
+
+		buf->context = urb;
+		buf->data = urb->transfer_buffer;
+		buf->length = wired->data_port.buffer_length_out;
+
+		return 0;
+	}
+
+	entry = list_first_entry_or_null(&wired->overflow_free,
+					  typeof(*entry), node);
+	if (!entry) {
+		wired->tx_drops++;
+		spin_unlock_irqrestore(&wired->overflow_lock, flags);
+		return -ENOSPC;
+	}
+
+	list_del(&entry->node);
+	spin_unlock_irqrestore(&wired->overflow_lock, flags);
+
+	buf->context = entry;
+	buf->data = entry->data;
+	buf->length = XONE_WIRED_LEN_DATA_PKT;
+
+	return 0;
+}
+
+static int xone_wired_submit_overflow(struct xone_wired *wired,
+				      struct gip_adapter_buffer *buf)
+{
+	struct xone_wired_overflow *entry = buf->context;
+	unsigned long flags;
+
+	entry->length = buf->length;
+
+	spin_lock_irqsave(&wired->overflow_lock, flags);
+
+	list_add_tail(&entry->node, &wired->overflow_queued);
+	wired->tx_overflows++;
+
+	/* URBs might have completed in the meantime */
+	xone_wired_flush_overflow(wired);
+
+	spin_unlock_irqrestore(&wired->overflow_lock, flags);
+
+	return 0;
+}
+
+/* buffer was taken before the endpoints got held */
+static int xone_wired_requeue_data(struct xone_wired *wired,
+				   struct gip_adapter_buffer *buf)
+{
+	struct xone_wired_overflow *entry;
+	struct urb *urb = buf->context;
+	unsigned long flags;
+
+	spin_lock_irqsave(&wired->overflow_lock, flags);
+
+	entry = list_first_entry_or_null(&wired->overflow_free,
+					  typeof(*entry), node);
+	if (entry) {
+		memcpy(entry->data, buf->data, buf->length);
+		entry->length = buf->length;
+		list_move_tail(&entry->node, &wired->overflow_queued);
+		wired->tx_overflows++;
+	} else {
+		wired->tx_drops++;
+	}
+
+	usb_anchor_urb(urb, &wired->data_port.urbs_out_idle);
+	usb_free_urb(urb);
+
+	/* hold might have ended in the meantime */
+	xone_wired_flush_overflow(wired);
+
+	spin_unlock_irqrestore(&wired->overflow_lock, flags);
+
+	return entry ? 0 : -ENOSPC;
+}
+
 static int xone_wired_get_buffer(struct gip_adapter *adap,
 				 struct gip_adapter_buffer *buf)
 {
@@ -214,7 +541,7 @@ static int xone_wired_get_buffer(struct gip_adapter *adap,
 	struct urb *urb;
 
 	if (buf->type == GIP_BUF_DATA)
-		port = &wired->data_port;
+		return xone_wired_get_data_buffer(wired, buf);
 	else if (buf->type == GIP_BUF_AUDIO)
 		port = &wired->audio_port;
 	else
@@ -237,8 +564,15 @@ static int xone_wired_submit_buffer(struct gip_adapter *adap,
 	struct xone_wired *wired = dev_get_drvdata(&adap->dev);
 	struct xone_wired_port *port;
 	struct urb *urb = buf->context;
+	unsigned long flags;
 	int err;
 
+	if (buf->type == GIP_BUF_DATA && xone_wired_is_overflow(wired, urb))
+		return xone_wired_submit_overflow(wired, buf);
+
+	if (buf->type == GIP_BUF_DATA && READ_ONCE(wired->tx_held))
+		return xone_wired_requeue_data(wired, buf);
+
 	if (buf->type == GIP_BUF_DATA)
 		port = &wired->data_port;
 	else if (buf->type == GIP_BUF_AUDIO)
@@ -247,6 +581,9 @@ static int xone_wired_submit_buffer(struct gip_adapter *adap,
 		return -EINVAL;
 
 	urb->transfer_buffer_length = buf->length;
+	if (buf->type == GIP_BUF_DATA)
+		urb->interval = READ_ONCE(wired->urb_interval_out);
+
 	usb_anchor_urb(urb, &port->urbs_out_busy);
 
 	err = usb_submit_urb(urb, GFP_ATOMIC);
@@ -257,6 +594,12 @@ static int xone_wired_submit_buffer(struct gip_adapter *adap,
 
 	usb_free_urb(urb);
 
+	if (err && buf->type == GIP_BUF_DATA) {
+		spin_lock_irqsave(&wired->overflow_lock, flags);
+		wired->tx_drops++;
+		spin_unlock_irqrestore(&wired->overflow_lock, flags);
+	}
+
 	return err;
 }
 
@@ -391,6 +734,194 @@ static struct gip_adapter_ops xone_wired_adapter_ops = {
 	.disable_audio = xone_wired_disable_audio,
 };
 
+static ssize_t xone_wired_report_rate_show(struct device *dev,
+					   struct device_attribute *attr,
+					   char *buf)
+{
+	struct xone_wired *wired = usb_get_intfdata(to_usb_interface(dev));
+	ktime_t start = READ_ONCE(wired->rate_start);
+	unsigned int rate = READ_ONCE(wired->report_rate);
+
+	/* reports have stopped */
+	if (ktime_ms_delta(ktime_get(), start) > 2 * MSEC_PER_SEC)
+		rate = 0;
+
+	return sprintf(buf, "%u\n", rate);
+}
+
+static int xone_wired_apply_intervals(struct xone_wired *wired)
+{
+	struct xone_wired_port *port = &wired->data_port;
+	unsigned long flags;
+	int i, err;
+
+	lockdep_assert_held(&wired->interval_lock);
+
+	/* new data packets wait in the overflow queue */
+	spin_lock_irqsave(&wired->overflow_lock, flags);
+	WRITE_ONCE(wired->tx_held, true);
+	spin_unlock_irqrestore(&wired->overflow_lock, flags);
+
+	xone_wired_kill_urbs_in(wired);
+	usb_kill_anchored_urbs(&port->urbs_out_busy);
+
+	port->ep_in->bInterval = xone_wired_encode_interval(wired,
+							    wired->interval_in,
+							    wired->advertised_in);
+	port->ep_out->bInterval = xone_wired_encode_interval(wired,
+							     wired->interval_out,
+							     wired->advertised_out);
+
+	/* host controllers take the interval from the endpoint descriptor */
+	err = usb_set_interface(wired->udev, XONE_WIRED_INTF_DATA, 0);
+	if (err)
+		dev_err(port->dev, "%s: set interface failed: %d\n",
+			__func__, err);
+
+	WRITE_ONCE(wired->urb_interval_out,
+		   xone_wired_urb_interval(wired, port->ep_out));
+
+	spin_lock_irqsave(&wired->overflow_lock, flags);
+	WRITE_ONCE(wired->tx_held, false);
+	xone_wired_flush_overflow(wired);
+	spin_unlock_irqrestore(&wired->overflow_lock, flags);
+	ewma_xone_arrival_init(&wired->arrival_avg);
+	wired->last_report = 0;
+
+	for (i = 0; i < wired->num_urbs_in; i++) {
+		wired->urbs_in[i]->interval = xone_wired_urb_interval(wired,
+								      port->ep_in);
+		err = usb_submit_urb(wired->urbs_in[i], GFP_KERNEL);
+		if (err) {
+			dev_err(port->dev, "%s: submit failed: %d\n",
+				__func__, err);
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static ssize_t xone_wired_store_interval(struct device *dev,
+					 const char *buf, size_t count,
+					 unsigned int *interval)
+{
+	struct xone_wired *wired = usb_get_intfdata(to_usb_interface(dev));
+	unsigned int ms;
+	int err;
+
+	err = kstrtouint(buf, 10, &ms);
+	if (err)
+		return err;
+
+	if (ms > 255)
+		return -EINVAL;
+
+	dev_dbg(dev, "%s: interval=%u\n", __func__, ms);
+
+	mutex_lock(&wired->interval_lock);
+	*interval = ms;
+	err = xone_wired_apply_intervals(wired);
+	mutex_unlock(&wired->interval_lock);
+
+	if (err)
+		return err;
+
+	return count;
+}
+
+static ssize_t xone_wired_poll_interval_in_show(struct device *dev,
+						struct device_attribute *attr,
+						char *buf)
+{
+	struct xone_wired *wired = usb_get_intfdata(to_usb_interface(dev));
+
+	return sprintf(buf, "%u\n", wired->interval_in);
+}
+
+static ssize_t xone_wired_poll_interval_in_store(struct device *dev,
+						 struct device_attribute *attr,
+						 const char *buf, size_t count)
+{
+	struct xone_wired *wired = usb_get_intfdata(to_usb_interface(dev));
+
+	return xone_wired_store_interval(dev, buf, count,
+					 &wired->interval_in);
+}
+
+static ssize_t xone_wired_poll_interval_out_show(struct device *dev,
+						 struct device_attribute *attr,
+						 char *buf)
+{
+	struct xone_wired *wired = usb_get_intfdata(to_usb_interface(dev));
+
+	return sprintf(buf, "%u\n", wired->interval_out);
+}
+
+static ssize_t xone_wired_poll_interval_out_store(struct device *dev,
+						  struct device_attribute *attr,
+						  const char *buf, size_t count)
+{
+	struct xone_wired *wired = usb_get_intfdata(to_usb_interface(dev));
+
+	return xone_wired_store_interval(dev, buf, count,
+					 &wired->interval_out);
+}
+
+static ssize_t xone_wired_inter_arrival_us_show(struct device *dev,
+						struct device_attribute *attr,
+						char *buf)
+{
+	struct xone_wired *wired = usb_get_intfdata(to_usb_interface(dev));
+
+	return sprintf(buf, "%lu\n",
+		       ewma_xone_arrival_read(&wired->arrival_avg));
+}
+
+static ssize_t xone_wired_tx_overflows_show(struct device *dev,
+					    struct device_attribute *attr,
+					    char *buf)
+{
+	struct xone_wired *wired = usb_get_intfdata(to_usb_interface(dev));
+
+	return sprintf(buf, "%lu\n", READ_ONCE(wired->tx_overflows));
+}
+
+static ssize_t xone_wired_tx_drops_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct xone_wired *wired = usb_get_intfdata(to_usb_interface(dev));
+
+	return sprintf(buf, "%lu\n", READ_ONCE(wired->tx_drops));
+}
+
+static struct device_attribute xone_wired_attr_report_rate =
+	__ATTR(report_rate, 0444, xone_wired_report_rate_show, NULL);
+static struct device_attribute xone_wired_attr_poll_interval_in =
+	__ATTR(poll_interval_in, 0644, xone_wired_poll_interval_in_show,
+	       xone_wired_poll_interval_in_store);
+static struct device_attribute xone_wired_attr_poll_interval_out =
+	__ATTR(poll_interval_out, 0644, xone_wired_poll_interval_out_show,
+	       xone_wired_poll_interval_out_store);
+static struct device_attribute xone_wired_attr_inter_arrival_us =
+	__ATTR(inter_arrival_us, 0444, xone_wired_inter_arrival_us_show, NULL);
+static struct device_attribute xone_wired_attr_tx_overflows =
+	__ATTR(tx_overflows, 0444, xone_wired_tx_overflows_show, NULL);
+static struct device_attribute xone_wired_attr_tx_drops =
+	__ATTR(tx_drops, 0444, xone_wired_tx_drops_show, NULL);
+
+static struct attribute *xone_wired_attrs[] = {
+	&xone_wired_attr_report_rate.attr,
+	&xone_wired_attr_poll_interval_in.attr,
+	&xone_wired_attr_poll_interval_out.attr,
+	&xone_wired_attr_inter_arrival_us.attr,
+	&xone_wired_attr_tx_overflows.attr,
+	&xone_wired_attr_tx_drops.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(xone_wired);
+
 static struct usb_driver xone_wired_driver;
 
 static int xone_wired_find_isoc_endpoints(struct usb_host_interface *alt,
@@ -429,6 +960,8 @@ static int xone_wired_init_data_port(struct xone_wired *wired,
 		return err;
 
 	port->dev = &intf->dev;
+	wired->advertised_in = port->ep_in->bInterval;
+	wired->advertised_out = port->ep_out->bInterval;
 
 	return 0;
 }
@@ -483,6 +1016,11 @@ static int xone_wired_probe(struct usb_interface *intf,
 		return -ENOMEM;
 
 	wired->udev = interface_to_usbdev(intf);
+	mutex_init(&wired->interval_lock);
+	ewma_xone_arrival_init(&wired->arrival_avg);
+	spin_lock_init(&wired->overflow_lock);
+	INIT_LIST_HEAD(&wired->overflow_free);
+	INIT_LIST_HEAD(&wired->overflow_queued);
 
 	/* newer devices require a reset after system sleep */
 	usb_reset_device(wired->udev);
@@ -518,6 +1056,8 @@ static int xone_wired_probe(struct usb_interface *intf,
 	return 0;
 
 err_free_urbs:
+	xone_wired_kill_urbs_in(wired);
+	xone_wired_free_urbs_in(wired);
 	xone_wired_free_urbs(&wired->data_port);
 	gip_destroy_adapter(wired->adapter);
 
@@ -532,15 +1072,20 @@ static void xone_wired_disconnect(struct usb_interface *intf)
 	if (!wired)
 		return;
 
-	usb_kill_urb(wired->data_port.urb_in);
+	xone_wired_kill_urbs_in(wired);
 	usb_kill_urb(wired->audio_port.urb_in);
 
 	/* also disables the audio interface */
 	gip_destroy_adapter(wired->adapter);
 
 	usb_kill_anchored_urbs(&wired->data_port.urbs_out_busy);
+	xone_wired_free_urbs_in(wired);
 	xone_wired_free_urbs(&wired->data_port);
 
+	/* overrides are stored in the shared endpoint descriptors */
+	wired->data_port.ep_in->bInterval = wired->advertised_in;
+	wired->data_port.ep_out->bInterval = wired->advertised_out;
+
 	usb_set_intfdata(intf, NULL);
 }
 
@@ -571,6 +1116,7 @@ static struct usb_driver xone_wired_driver = {
 	.probe = xone_wired_probe,
 	.disconnect = xone_wired_disconnect,
 	.id_table = xone_wired_id_table,
+	.dev_groups = xone_wired_groups,
 };
 
 module_usb_driver(xone_wired_driver);